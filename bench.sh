@@ -0,0 +1,105 @@
+#!/bin/bash
+# Benchmark of ecosystem_seq and ecosystem over ecosystem_examples.
+# Uso: ./bench.sh   (built and run by "make bench")
+#
+# Environment:
+#   THREADS  thread counts for ./ecosystem          (default: "1 2 4 8 16")
+#   REPS     repetitions of every run               (default: 5)
+#   INPUTS   input files                            (default: ecosystem_examples/input*)
+#   ARGS     extra options for ./ecosystem, e.g. "-e band"
+#   OUT      prefix of the result files             (default: bench_results)
+#
+# Every run is checked against the matching output* file (inputs without one are only timed).
+# Results go to $OUT.csv (one line per input/program/threads: median, min and stddev of the
+# times, speedup over the sequential program, speedup over 1 thread and parallel efficiency)
+# and $OUT.json; the speedup and efficiency matrices are printed on stdout.
+
+THREADS=${THREADS:-"1 2 4 8 16"}
+REPS=${REPS:-5}
+INPUTS=${INPUTS:-$(ls ecosystem_examples/input*)}
+OUT=${OUT:-bench_results}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+failed=0
+: > "$TMP/times"
+
+# run <input> <program> <threads> <command...>: REPS timed runs, checked against the expected output
+run() {
+    local input=$1 prog=$2 threads=$3 expected
+    shift 3
+    expected=${input/input/output}
+    for ((rep = 0; rep < REPS; rep++)); do
+        "$@" < "$input" > "$TMP/out" 2> "$TMP/err"
+        if [ -f "$expected" ] && ! cmp -s "$TMP/out" "$expected"; then
+            echo "Erro: $prog $threads < $input differs from $expected" >&2
+            failed=1
+        fi
+        ms=$(grep -o 'Execution Time[^:]*: [0-9.]*' "$TMP/err" | awk '{print $NF}')
+        echo "$(basename "$input") $prog $threads $ms" >> "$TMP/times"
+    done
+}
+
+for input in $INPUTS; do
+    echo "$input" >&2
+    run "$input" seq 1 ./ecosystem_seq
+    for t in $THREADS; do
+        run "$input" par "$t" ./ecosystem $ARGS "$t"
+    done
+done
+
+# Aggregate the repetitions (input, program, threads order is kept from the runs)
+awk -v csv="$OUT.csv" -v json="$OUT.json" -v threads="$THREADS" -v reps="$REPS" -v args="$ARGS" '
+    {
+        key = $1 " " $2 " " $3
+        if (!(key in n)) { order[++keys] = key; inp[key] = $1; prog[key] = $2; thr[key] = $3 }
+        t[key, ++n[key]] = $4
+        if (!($1 in seen)) { seen[$1] = 1; inputs[++n_inputs] = $1 }
+    }
+    END {
+        for (k = 1; k <= keys; k++) {
+            key = order[k]; m = n[key]
+            for (i = 1; i <= m; i++) v[i] = t[key, i]
+            for (i = 2; i <= m; i++) for (j = i; j > 1 && v[j - 1] > v[j]; j--) { x = v[j]; v[j] = v[j - 1]; v[j - 1] = x }
+            med[key] = m % 2 ? v[(m + 1) / 2] : (v[m / 2] + v[m / 2 + 1]) / 2
+            mn[key] = v[1]
+            sum = 0; for (i = 1; i <= m; i++) sum += v[i]
+            mean = sum / m; sq = 0
+            for (i = 1; i <= m; i++) sq += (v[i] - mean) ^ 2
+            sd[key] = m > 1 ? sqrt(sq / (m - 1)) : 0
+        }
+        print "input,program,threads,reps,median_ms,min_ms,stddev_ms,speedup_seq,speedup_rel,efficiency" > csv
+        printf "{\n  \"reps\": %d,\n  \"args\": \"%s\",\n  \"results\": [\n", reps, args > json
+        for (k = 1; k <= keys; k++) {
+            key = order[k]
+            s = med[inp[key] " seq 1"]; base = med[inp[key] " par 1"]
+            sp[key] = med[key] > 0 ? s / med[key] : 0
+            rel = (base != "" && med[key] > 0) ? base / med[key] : 0
+            eff[key] = sp[key] / thr[key]
+            printf "%s,%s,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", inp[key], prog[key], thr[key], n[key],
+                   med[key], mn[key], sd[key], sp[key], rel, eff[key] > csv
+            printf "    {\"input\": \"%s\", \"program\": \"%s\", \"threads\": %d, \"median_ms\": %.3f, \"min_ms\": %.3f, " \
+                   "\"stddev_ms\": %.3f, \"speedup_seq\": %.3f, \"speedup_rel\": %.3f, \"efficiency\": %.3f}%s\n",
+                   inp[key], prog[key], thr[key], med[key], mn[key], sd[key], sp[key], rel, eff[key],
+                   k < keys ? "," : "" > json
+        }
+        print "  ]\n}" > json
+
+        n_thr = split(threads, th, " ")
+        for (mat = 1; mat <= 2; mat++) {
+            printf "\n%s\n%-24s", mat == 1 ? "Speedup over ecosystem_seq (median)" : "Parallel efficiency", "input"
+            for (i = 1; i <= n_thr; i++) printf "%8s", th[i]
+            printf "\n"
+            for (i = 1; i <= n_inputs; i++) {
+                printf "%-24s", inputs[i]
+                for (j = 1; j <= n_thr; j++) {
+                    key = inputs[i] " par " th[j]
+                    printf "%8.2f", mat == 1 ? sp[key] : eff[key]
+                }
+                printf "\n"
+            }
+        }
+    }' "$TMP/times"
+
+echo "Results: $OUT.csv $OUT.json" >&2
+exit $failed
@@ -1,52 +1,427 @@
+#define _GNU_SOURCE // sched_setaffinity
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sched.h>
 #include <omp.h>
 #include <time.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "ecosystem_io.h"
 
-#define EMPTY 0
-#define ROCK 1
-#define RABBIT 2
-#define FOX 3
+// Results of rabbit_move / fox_move besides a direction
+#define STAY -1
+#define DIE -2
 
-#define LOCK_SIZE 65536
-#define LOCK_MASK 0xFFFF
+#define CACHE_LINE 64
+#define HUGE_PAGE (2 << 20)
+// Lock slots of the push kernels: one per SLOT_CELLS consecutive cells, a power of two of them
+// within these bounds. Larger worlds wrap around the table, which stays within 1 MiB so that it
+// is cache resident (a table covering a 2000x2000 world without wrapping ran 15% slower)
+#define SLOT_SHIFT 4
+#define SLOT_CELLS (1 << SLOT_SHIFT)
+#define MIN_LOCKS 64
+#define MAX_LOCKS (1 << 14)
 
+// Ages are stored in narrow planes: 8 bits by default, 16 bits with -DWIDE_AGES.
+// Rabbit proc_age saturates at GEN_PROC_RABBITS + 1 (every age above GEN_PROC_RABBITS
+// behaves the same), fox ages are bounded by GEN_PROC_FOXES + GEN_FOOD_FOXES.
+#ifdef WIDE_AGES
+typedef uint16_t Age;
+#define AGE_MAX 0xFFFF
+#else
+typedef uint8_t Age;
+#define AGE_MAX 0xFF
+#endif
+
+// Value of a single cell, used to resolve conflicts
 typedef struct {
     int type;
     int proc_age;
     int food_age;
 } Cell;
 
+// Structure-of-arrays grid: the neighbour scans only touch the type plane
+typedef struct {
+    uint8_t *type;
+    Age *proc_age;
+    Age *food_age;
+} Grid;
+
+// Breeding and starvation ages of a world (GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES)
+typedef struct {
+    int proc_rabbits;
+    int proc_foxes;
+    int food_foxes;
+} Rules;
+
+#ifndef LOCK_FREE
+// Lock slot of the push kernels, alone on its cache line: two slots never share a line (the cells
+// mapped to one slot do, see lock_slot)
+typedef struct {
+    omp_lock_t lock;
+} __attribute__((aligned(CACHE_LINE))) LockSlot;
+#endif
+
+#ifdef LOCK_FREE
+// Packed cell used as the compare-and-swap target of the lock-free build:
+// type in bits 62-63, proc_age in bits 31-61, (PACK_AGE_MASK - food_age) in bits 0-30.
+// The layout is ordered so that the winner of every conflict is the larger word.
+typedef uint64_t Packed;
+#define PACK_AGE_MASK 0x7FFFFFFFULL
+#endif
+
 int GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES, N_GEN, R, C, N;
-Cell *grid1;
-Cell *grid2;
-omp_lock_t locks[LOCK_SIZE];
+Grid grid1;
+Grid grid2;
+signed char *moves; // Direction chosen by the animal of each cell (gather engine)
+uint8_t *rock_row; // C cells of ROCK: the row above the first row and below the last one
+#ifdef LOCK_FREE
+Packed *cells1; // Merge target of the fox phase, unpacked into grid1
+Packed *cells2; // Merge target of the rabbit phase, unpacked into grid2
+#else
+LockSlot *locks;
+int n_locks; // A power of two
+#endif
+
+// World arena: the planes of grid1 and grid2, moves, rock_row and the merge state of the push
+// kernels (lock slots or packed cells) come from one mapping, every array on its own cache
+// lines. A world of 2 MiB or more is mapped on a 2 MiB boundary and advised for transparent
+// hugepages, so it takes few TLB entries; ECOSYSTEM_HUGEPAGES=explicit maps it from the
+// hugetlbfs pool instead (transparent pages when the pool is empty), =0 keeps base pages.
+typedef struct {
+    char *base;
+    size_t size, used;
+    const char *pages; // "explicit", "transparent" or "base"
+} Arena;
+
+Arena arena = {NULL, 0, 0, "base"};
+
+static inline size_t line_bytes(size_t bytes) {
+    return (bytes + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+}
+
+void arena_open(size_t bytes) {
+    const char *mode = getenv("ECOSYSTEM_HUGEPAGES");
+    int huge = bytes >= HUGE_PAGE && !(mode && strcmp(mode, "0") == 0);
+    size_t page = huge ? HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+    arena.size = (bytes + page - 1) / page * page;
+    arena.used = 0;
+    arena.pages = "base";
+    char *base = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge && strcmp(mode ? mode : "", "explicit") == 0) {
+        base = mmap(NULL, arena.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED) arena.pages = "explicit";
+    }
+#endif
+    if (base == MAP_FAILED) {
+        // One extra huge page, trimmed on both sides, so the arena starts on a 2 MiB boundary
+        size_t extra = huge ? HUGE_PAGE : 0;
+        char *raw = mmap(NULL, arena.size + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) {
+            fprintf(stderr, "Erro ao alocar memória\n");
+            exit(EXIT_FAILURE);
+        }
+        base = huge ? (char *)(((uintptr_t)raw + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1)) : raw;
+        if (base > raw) munmap(raw, base - raw);
+        if (raw + extra > base) munmap(base + arena.size, raw + extra - base);
+#ifdef MADV_HUGEPAGE
+        if (huge && madvise(base, arena.size, MADV_HUGEPAGE) == 0) arena.pages = "transparent";
+#endif
+    }
+    arena.base = base;
+}
+
+// Next bytes of the arena, on a cache line of their own (the mapping is zero-filled)
+void *arena_take(size_t bytes) {
+    void *p = arena.base + arena.used;
+    arena.used += line_bytes(bytes);
+    return p;
+}
+
+void arena_close() {
+    if (arena.base) munmap(arena.base, arena.size);
+    arena.base = NULL;
+}
+
+void alloc_grid(Grid *g, size_t n_cells) {
+    g->type = (uint8_t *)calloc(n_cells, sizeof(uint8_t));
+    g->proc_age = (Age *)calloc(n_cells, sizeof(Age));
+    g->food_age = (Age *)calloc(n_cells, sizeof(Age));
+    if (!g->type || !g->proc_age || !g->food_age) {
+        fprintf(stderr, "Erro ao alocar memória\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void free_grid(Grid *g) {
+    free(g->type);
+    free(g->proc_age);
+    free(g->food_age);
+}
+
+// First touch: the pages of a large malloc are only placed on a NUMA node when first written,
+// so the world arrays are zeroed in parallel by contiguous row blocks, thread t owning rows
+// [t * R / n, (t + 1) * R / n) like the bands of the band engine and the static loops. Pinned
+// threads (--affinity) then find their rows on their own node. ECOSYSTEM_NO_FIRST_TOUCH=1 zeroes
+// everything from the master thread instead, for comparison.
+void first_touch(void **planes, const size_t *cell_bytes, int n_planes) {
+    const char *off = getenv("ECOSYSTEM_NO_FIRST_TOUCH");
+    int serial = off && strcmp(off, "0") != 0;
+    #pragma omp parallel if(!serial)
+    {
+        int t = omp_get_thread_num(), n = omp_get_num_threads();
+        size_t lo = (size_t)(t * (long long)R / n) * C, hi = (size_t)((t + 1) * (long long)R / n) * C;
+        for (int k = 0; k < n_planes; k++)
+            memset((char *)planes[k] + lo * cell_bytes[k], 0, (hi - lo) * cell_bytes[k]);
+    }
+}
+
+void alloc_world_grid(Grid *g) {
+    size_t n_cells = (size_t)R * C;
+    g->type = (uint8_t *)arena_take(n_cells * sizeof(uint8_t));
+    g->proc_age = (Age *)arena_take(n_cells * sizeof(Age));
+    g->food_age = (Age *)arena_take(n_cells * sizeof(Age));
+    void *planes[] = {g->type, g->proc_age, g->food_age};
+    size_t bytes[] = {sizeof(uint8_t), sizeof(Age), sizeof(Age)};
+    first_touch(planes, bytes, 3);
+}
 
 void init_grids() {
-    grid1 = (Cell *)calloc(R * C, sizeof(Cell));
-    grid2 = (Cell *)calloc(R * C, sizeof(Cell));
-    
+    size_t n_cells = (size_t)R * C;
+    size_t grid_bytes = line_bytes(n_cells * sizeof(uint8_t)) + 2 * line_bytes(n_cells * sizeof(Age));
+#ifdef LOCK_FREE
+    size_t sync_bytes = 2 * line_bytes(n_cells * sizeof(Packed));
+#else
+    // The slots grow with the grid, so that large worlds do not alias many cells onto each lock
+    n_locks = MIN_LOCKS;
+    while (n_locks < MAX_LOCKS && (size_t)n_locks * SLOT_CELLS < n_cells) n_locks *= 2;
+    size_t sync_bytes = line_bytes(n_locks * sizeof(LockSlot));
+#endif
+    arena_open(2 * grid_bytes + line_bytes(n_cells * sizeof(signed char)) + line_bytes(C) + sync_bytes);
+    alloc_world_grid(&grid1);
+    alloc_world_grid(&grid2);
+    moves = (signed char *)arena_take(n_cells * sizeof(signed char));
+    rock_row = (uint8_t *)arena_take(C);
+    void *planes[] = {moves};
+    size_t bytes[] = {sizeof(signed char)};
+    first_touch(planes, bytes, 1);
+    memset(rock_row, ROCK, C);
+    // Reserved here, set up by the first engine that uses them (init_push_state)
+#ifdef LOCK_FREE
+    cells1 = (Packed *)arena_take(n_cells * sizeof(Packed));
+    cells2 = (Packed *)arena_take(n_cells * sizeof(Packed));
+#else
+    locks = (LockSlot *)arena_take(n_locks * sizeof(LockSlot));
+#endif
+}
+
+// Merge targets of the push kernels (push and steal engines): the lock table, or the packed cells
+// with -DLOCK_FREE. Set up on the first run of one of those engines, so the others never pay for
+// the lock initialisations or the first touch of the packed cells.
+int push_ready = 0;
+
+void init_push_state() {
+    if (push_ready) return;
+    push_ready = 1;
+#ifdef LOCK_FREE
+    void *planes[] = {cells1, cells2};
+    size_t bytes[] = {sizeof(Packed), sizeof(Packed)};
+    first_touch(planes, bytes, 2);
+#else
     #pragma omp parallel for
-    for (int i = 0; i < LOCK_SIZE; i++) {
-        omp_init_lock(&locks[i]);
+    for (int i = 0; i < n_locks; i++) {
+        omp_init_lock(&locks[i].lock);
     }
+#endif
 }
 
 void destroy_grids() {
-    #pragma omp parallel for
-    for (int i = 0; i < LOCK_SIZE; i++) {
-        omp_destroy_lock(&locks[i]);
+#ifndef LOCK_FREE
+    if (push_ready) {
+        #pragma omp parallel for
+        for (int i = 0; i < n_locks; i++) {
+            omp_destroy_lock(&locks[i].lock);
+        }
+    }
+#endif
+    push_ready = 0;
+    arena_close();
+}
+
+// Check the world against the limits of the compact layout and report its memory use
+int check_limits() {
+    if ((long long)R * C > 0x7FFFFFFF) {
+        fprintf(stderr, "Grid %dx%d exceeds the %d cells limit\n", R, C, 0x7FFFFFFF);
+        return 0;
     }
-    free(grid1);
-    free(grid2);
+    if (GEN_PROC_RABBITS + 1 > AGE_MAX || GEN_PROC_FOXES + GEN_FOOD_FOXES > AGE_MAX) {
+        fprintf(stderr, "GEN_PROC_* / GEN_FOOD_FOXES exceed the %d-bit age planes (rebuild with -DWIDE_AGES)\n",
+                (int)(8 * sizeof(Age)));
+        return 0;
+    }
+    size_t cell_bytes = 2 * (sizeof(uint8_t) + 2 * sizeof(Age)) + sizeof(signed char);
+#ifdef LOCK_FREE
+    cell_bytes += 2 * sizeof(Packed);
+#endif
+    fprintf(stderr, "Grid %dx%d: %zu bytes/cell, %.1f MiB\n", R, C, cell_bytes,
+            (double)R * C * cell_bytes / (1024.0 * 1024.0));
+    return 1;
+}
+
+static inline Cell get_cell(Grid g, int idx) {
+    Cell cell = {g.type[idx], g.proc_age[idx], g.food_age[idx]};
+    return cell;
+}
+
+static inline void set_cell(Grid g, int idx, Cell cell) {
+    g.type[idx] = (uint8_t)cell.type;
+    g.proc_age[idx] = (Age)cell.proc_age;
+    g.food_age[idx] = (Age)cell.food_age;
 }
 
+const int dr[] = {-1, 0, 1, 0}; // N, E, S, W
+const int dc[] = {0, 1, 0, -1};
+
 int get_adjacent_index(int gen, int r, int c, int p_count) {
     // Calculate adjacent index with wrap-around
     return (gen + r + c) % p_count;
 }
 
+// Next proc_age of a rabbit, saturated at GEN_PROC_RABBITS + 1 so it fits in an Age
+static inline int rabbit_age(int proc_age) {
+    return proc_age > GEN_PROC_RABBITS ? proc_age : proc_age + 1;
+}
+
+// Neighbour masks: bit k (direction k = N, E, S, W) of the low nibble is set when that
+// neighbour is EMPTY, bit k of the high nibble when it is a RABBIT. Cells outside the grid
+// count as neither.
+#define EMPTY_MASK(m) ((m) & 0xF)
+#define RABBIT_MASK(m) ((m) >> 4)
+
+// nth_dir[m][k]: direction of the k-th set bit of the 4-bit mask m
+const signed char nth_dir[16][4] = {
+    {-1, -1, -1, -1}, { 0, -1, -1, -1}, { 1, -1, -1, -1}, { 0,  1, -1, -1},
+    { 2, -1, -1, -1}, { 0,  2, -1, -1}, { 1,  2, -1, -1}, { 0,  1,  2, -1},
+    { 3, -1, -1, -1}, { 0,  3, -1, -1}, { 1,  3, -1, -1}, { 0,  1,  3, -1},
+    { 2,  3, -1, -1}, { 0,  2,  3, -1}, { 1,  2,  3, -1}, { 0,  1,  2,  3},
+};
+
+static inline uint8_t type_bits(int type, int k) {
+    return (uint8_t)(((type == EMPTY) << k) | ((type == RABBIT) << (k + 4)));
+}
+
+// Neighbour mask of cell (i, j) of a type plane
+static inline uint8_t cell_mask(const uint8_t *type, int i, int j) {
+    int idx = i * C + j;
+    uint8_t m = 0;
+    if (i > 0) m |= type_bits(type[idx - C], 0);
+    if (j < C - 1) m |= type_bits(type[idx + 1], 1);
+    if (i < R - 1) m |= type_bits(type[idx + C], 2);
+    if (j > 0) m |= type_bits(type[idx - 1], 3);
+    return m;
+}
+
+// Rows above and below row i of a type plane, rock_row outside the grid: the row kernels read
+// the sentinel instead of testing i against the grid bounds
+static inline const uint8_t *row_above(const uint8_t *type, int i) {
+    return i > 0 ? type + (size_t)(i - 1) * C : rock_row;
+}
+
+static inline const uint8_t *row_below(const uint8_t *type, int i) {
+    return i < R - 1 ? type + (size_t)(i + 1) * C : rock_row;
+}
+
+// Neighbour masks of cells [j_from, j_to) of row i, one cell at a time; the first and last
+// column go through cell_mask, the others probe their four neighbours unchecked
+void row_masks_scalar(const uint8_t *type, int i, int j_from, int j_to, uint8_t *out) {
+    const uint8_t *row = type + (size_t)i * C, *up = row_above(type, i), *down = row_below(type, i);
+    int j = j_from;
+    if (j == 0 && j < j_to) out[j] = cell_mask(type, i, j), j++;
+    int interior_to = j_to < C - 1 ? j_to : C - 1;
+    for (; j < interior_to; j++)
+        out[j] = type_bits(up[j], 0) | type_bits(row[j + 1], 1) | type_bits(down[j], 2) | type_bits(row[j - 1], 3);
+    for (; j < j_to; j++) out[j] = cell_mask(type, i, j);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// Neighbour masks of row i, 32 cells per iteration; the first and last cell of the row
+// (and the tail that does not fill a vector) go through the scalar path
+__attribute__((target("avx2")))
+void row_masks_avx2(const uint8_t *type, int i, uint8_t *out) {
+    const uint8_t *row = type + (size_t)i * C, *up = row_above(type, i), *down = row_below(type, i);
+    const __m256i empty = _mm256_set1_epi8(EMPTY);
+    const __m256i rabbit = _mm256_set1_epi8(RABBIT);
+    int j = 1;
+    row_masks_scalar(type, i, 0, 1, out);
+    for (; j + 32 < C; j += 32) {
+        __m256i nb[4];
+        nb[0] = _mm256_loadu_si256((const __m256i *)(up + j));
+        nb[1] = _mm256_loadu_si256((const __m256i *)(row + j + 1));
+        nb[2] = _mm256_loadu_si256((const __m256i *)(down + j));
+        nb[3] = _mm256_loadu_si256((const __m256i *)(row + j - 1));
+        __m256i m = _mm256_setzero_si256();
+        for (int k = 0; k < 4; k++) {
+            m = _mm256_or_si256(m, _mm256_and_si256(_mm256_cmpeq_epi8(nb[k], empty), _mm256_set1_epi8((char)(1 << k))));
+            m = _mm256_or_si256(m, _mm256_and_si256(_mm256_cmpeq_epi8(nb[k], rabbit), _mm256_set1_epi8((char)(1 << (k + 4)))));
+        }
+        _mm256_storeu_si256((__m256i *)(out + j), m);
+    }
+    row_masks_scalar(type, i, j, C, out);
+}
+#endif
+
+void row_masks_generic(const uint8_t *type, int i, uint8_t *out) {
+    row_masks_scalar(type, i, 0, C, out);
+}
+
+// Neighbour masks of a whole row, AVX2 or scalar, chosen at startup by select_row_masks()
+void (*row_masks)(const uint8_t *type, int i, uint8_t *out) = row_masks_generic;
+
+void select_row_masks() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2") && !getenv("ECOSYSTEM_NO_SIMD")) row_masks = row_masks_avx2;
+#endif
+}
+
+// Direction the rabbit with neighbour mask m at (i, j) moves to, or STAY if it has no empty neighbour
+static inline int rabbit_move(uint8_t m, int gen, int i, int j) {
+    int possible = EMPTY_MASK(m);
+    if (possible == 0) return STAY;
+    return nth_dir[possible][get_adjacent_index(gen, i, j, __builtin_popcount(possible))];
+}
+
+// Direction the fox with neighbour mask m at (i, j) moves to: adjacent rabbits first, then empty cells.
+// Returns STAY if it cannot move and DIE if it starves (at food_foxes generations without food);
+// *ate is set when it moves onto a rabbit.
+static inline int fox_move_rules(uint8_t m, int gen, int i, int j, int food_age, int food_foxes, int *ate) {
+    int rabbit_moves = RABBIT_MASK(m);
+    if (rabbit_moves != 0) {
+        *ate = 1;
+        return nth_dir[rabbit_moves][get_adjacent_index(gen, i, j, __builtin_popcount(rabbit_moves))];
+    }
+    *ate = 0;
+
+    // No rabbit. Check starvation.
+    if (food_age + 1 >= food_foxes) return DIE;
+
+    // Try to move to empty
+    int empty_moves = EMPTY_MASK(m);
+    if (empty_moves == 0) return STAY;
+    return nth_dir[empty_moves][get_adjacent_index(gen, i, j, __builtin_popcount(empty_moves))];
+}
+
+static inline int fox_move(uint8_t m, int gen, int i, int j, int food_age, int *ate) {
+    return fox_move_rules(m, gen, i, j, food_age, GEN_FOOD_FOXES, ate);
+}
+
 void solve_rabbit_conflict(Cell *dest, int proc_age) {
     // Assumes lock is held
     if (dest->type == EMPTY) {
@@ -78,98 +453,856 @@ void solve_fox_conflict(Cell *dest, int proc_age, int food_age) {
     }
 }
 
-int main(int argc, char *argv[]) {
-    omp_set_dynamic(0); // Disable dynamic teams 
+// solve_rabbit_conflict / solve_fox_conflict applied to a cell of a grid
+static inline void merge_rabbit(Grid g, int idx, int proc_age) {
+    Cell cell = get_cell(g, idx);
+    solve_rabbit_conflict(&cell, proc_age);
+    set_cell(g, idx, cell);
+}
 
-    // Set number of threads from command line argument
-    if (argc > 1) {
-        int n_threads = atoi(argv[1]); // Number of threads from command line
-        if (n_threads <= 0) {
-            fprintf(stderr, "Uso: %s <num_threads_positivo>\n", argv[0]);
-            exit(EXIT_FAILURE);
+static inline void merge_fox(Grid g, int idx, int proc_age, int food_age) {
+    Cell cell = get_cell(g, idx);
+    solve_fox_conflict(&cell, proc_age, food_age);
+    set_cell(g, idx, cell);
+}
+
+#ifdef LOCK_FREE
+Packed pack_cell(Cell cell) {
+    return ((Packed)cell.type << 62) | ((Packed)cell.proc_age << 31) | (PACK_AGE_MASK - (Packed)cell.food_age);
+}
+
+Cell unpack_cell(Packed p) {
+    Cell cell;
+    cell.type = (int)(p >> 62);
+    cell.proc_age = (int)((p >> 31) & PACK_AGE_MASK);
+    cell.food_age = (int)(PACK_AGE_MASK - (p & PACK_AGE_MASK));
+    return cell;
+}
+
+int merge_cell(Packed *dest, Packed p) {
+    // Atomic max: same outcome as solve_rabbit_conflict / solve_fox_conflict.
+    // Returns 1 for the animal that replaced a cell of another type (the first arrival).
+    Packed old = __atomic_load_n(dest, __ATOMIC_RELAXED);
+    while (p > old) {
+        if (__atomic_compare_exchange_n(dest, &old, p, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            return (old >> 62) != (p >> 62);
+    }
+    return 0;
+}
+#endif
+
+#ifdef PROFILE
+// Instrumentation (-DPROFILE, push engine): per-phase busy time of every thread, the time it
+// waits at the barrier closing the phase, animals processed, conflicts (merges onto a cell
+// another animal of the same species already reached) and, with the lock table, acquisitions
+// and contended acquisitions per lock bucket (counted while holding the bucket's lock).
+// A JSON line is written to $ECOSYSTEM_PROFILE (default stderr) at exit, and every
+// $ECOSYSTEM_PROFILE_EVERY generations if set. Without -DPROFILE the macros are empty.
+enum { PH_RABBITS, PH_RABBITS_COPY, PH_FOXES, PH_FOXES_COPY, N_PHASES };
+const char *phase_names[N_PHASES] = {"rabbits", "rabbits_copy", "foxes", "foxes_copy"};
+
+typedef struct {
+    double busy[N_PHASES], idle[N_PHASES];
+    double mark; // End of the last measured interval
+    long long animals, conflicts;
+} __attribute__((aligned(64))) ThreadProfile;
+
+ThreadProfile *prof;
+int prof_threads, prof_every;
+double prof_setup; // Initial copies of the engine (wall time)
+unsigned *lock_acquired, *lock_contended;
+
+void profile_init(int n_threads) {
+    if (prof && prof_threads >= n_threads) return;
+    free(prof);
+    prof = (ThreadProfile *)aligned_alloc(64, n_threads * sizeof(ThreadProfile));
+    memset(prof, 0, n_threads * sizeof(ThreadProfile));
+    prof_threads = n_threads;
+    const char *every = getenv("ECOSYSTEM_PROFILE_EVERY");
+    prof_every = every ? atoi(every) : 0;
+}
+
+#ifndef LOCK_FREE
+// Counters of lock_bucket, sized to the lock table of the world (every engine that takes the locks)
+void profile_locks() {
+    static int counted = 0;
+    if (counted >= n_locks) return;
+    free(lock_acquired);
+    free(lock_contended);
+    lock_acquired = (unsigned *)calloc(n_locks, sizeof(unsigned));
+    lock_contended = (unsigned *)calloc(n_locks, sizeof(unsigned));
+    counted = n_locks;
+}
+#endif
+
+void profile_report(int gen) {
+    if (!prof) return;
+    const char *path = getenv("ECOSYSTEM_PROFILE");
+    FILE *f = path ? fopen(path, "a") : stderr;
+    if (!f) return;
+    fprintf(f, "{\"gen\": %d, \"threads\": %d, \"setup_s\": %.6f, \"phases\": {", gen, prof_threads, prof_setup);
+    for (int ph = 0; ph < N_PHASES; ph++) {
+        // Every phase ends at a barrier, so thread 0's busy + idle time is the phase's wall time
+        fprintf(f, "%s\"%s\": {\"wall_s\": %.6f, \"busy_s\": [", ph ? ", " : "", phase_names[ph],
+                prof[0].busy[ph] + prof[0].idle[ph]);
+        for (int t = 0; t < prof_threads; t++) fprintf(f, "%s%.6f", t ? ", " : "", prof[t].busy[ph]);
+        fprintf(f, "], \"idle_s\": [");
+        for (int t = 0; t < prof_threads; t++) fprintf(f, "%s%.6f", t ? ", " : "", prof[t].idle[ph]);
+        fprintf(f, "]}");
+    }
+    fprintf(f, "}, \"animals\": [");
+    for (int t = 0; t < prof_threads; t++) fprintf(f, "%s%lld", t ? ", " : "", prof[t].animals);
+    fprintf(f, "], \"conflicts\": [");
+    for (int t = 0; t < prof_threads; t++) fprintf(f, "%s%lld", t ? ", " : "", prof[t].conflicts);
+    fprintf(f, "]");
+#ifndef LOCK_FREE
+    // Totals, then [bucket, acquired, contended] for every bucket that was contended
+    long long acquired = 0, contended = 0;
+    unsigned max_acquired = 0;
+    for (int b = 0; b < n_locks; b++) {
+        acquired += lock_acquired[b];
+        contended += lock_contended[b];
+        if (lock_acquired[b] > max_acquired) max_acquired = lock_acquired[b];
+    }
+    fprintf(f, ", \"locks\": {\"buckets\": %d, \"acquired\": %lld, \"contended\": %lld, \"max_acquired\": %u, \"contended_buckets\": [",
+            n_locks, acquired, contended, max_acquired);
+    for (int b = 0, first = 1; b < n_locks; b++) {
+        if (!lock_contended[b]) continue;
+        fprintf(f, "%s[%d, %u, %u]", first ? "" : ", ", b, lock_acquired[b], lock_contended[b]);
+        first = 0;
+    }
+    fprintf(f, "]}");
+#endif
+    fprintf(f, "}\n");
+    if (f != stderr) fclose(f);
+}
+
+#define PROF_NOWAIT nowait
+#define PROF_START() (prof[omp_get_thread_num()].mark = omp_get_wtime())
+#define PROF_COUNT(field) (prof[omp_get_thread_num()].field++)
+// Close the busy interval of phase ph, then wait at the barrier ending it
+#define PROF_BARRIER(ph) do { \
+        ThreadProfile *p_ = &prof[omp_get_thread_num()]; \
+        double t_ = omp_get_wtime(); \
+        p_->busy[ph] += t_ - p_->mark; \
+        _Pragma("omp barrier") \
+        p_->mark = omp_get_wtime(); \
+        p_->idle[ph] += p_->mark - t_; \
+    } while (0)
+// The loops of the kernels run with nowait and wait here instead of at their implicit barrier
+#define PROF_FOR_BARRIER(ph) PROF_BARRIER(ph)
+#define PROF_REPORT(gen) do { \
+        if (prof_every > 0 && (gen) % prof_every == 0) { \
+            _Pragma("omp master") profile_report(gen); \
+            _Pragma("omp barrier") \
+            PROF_START(); \
+        } \
+    } while (0)
+#else
+#define PROF_NOWAIT
+#define PROF_START() ((void)0)
+#define PROF_COUNT(field) ((void)0)
+#define PROF_BARRIER(ph) _Pragma("omp barrier")
+#define PROF_FOR_BARRIER(ph) ((void)0)
+#define PROF_REPORT(gen) ((void)0)
+#endif
+
+#ifndef LOCK_FREE
+// Lock slot of cell idx: each aligned run of SLOT_CELLS cells of the flattened grid shares one
+// slot, so a row scan takes a new lock line only every SLOT_CELLS cells. Nothing keeps rows apart:
+// a run straddles two rows when C is not a multiple of SLOT_CELLS, and the table repeats every
+// n_locks * SLOT_CELLS cells, so threads on different rows can still meet on a slot (it only
+// serialises them, the result does not depend on it)
+static inline int lock_slot(int idx) {
+    return (idx >> SLOT_SHIFT) & (n_locks - 1);
+}
+
+static inline void lock_bucket(int b) {
+#ifdef PROFILE
+    if (!omp_test_lock(&locks[b].lock)) {
+        omp_set_lock(&locks[b].lock);
+        lock_contended[b]++;
+    }
+    lock_acquired[b]++;
+#else
+    omp_set_lock(&locks[b].lock);
+#endif
+}
+#endif
+
+// Place a rabbit into the output of the rabbit phase (grid2).
+// Returns 1 if it is the first animal to arrive at the cell in this phase.
+static inline int place_rabbit(int idx, int proc_age) {
+#ifdef LOCK_FREE
+    Cell rabbit = {RABBIT, proc_age, 0};
+    return merge_cell(&cells2[idx], pack_cell(rabbit));
+#else
+    int b = lock_slot(idx);
+    lock_bucket(b);
+    int first = grid2.type[idx] != RABBIT;
+    merge_rabbit(grid2, idx, proc_age);
+    omp_unset_lock(&locks[b].lock);
+    return first;
+#endif
+}
+
+// Place a fox into the output of the fox phase (grid1).
+// Returns 1 if it is the first animal to arrive at the cell in this phase.
+static inline int place_fox(int idx, int proc_age, int food_age) {
+#ifdef LOCK_FREE
+    Cell fox = {FOX, proc_age, food_age};
+    return merge_cell(&cells1[idx], pack_cell(fox));
+#else
+    int b = lock_slot(idx);
+    lock_bucket(b);
+    int first = grid1.type[idx] != FOX;
+    merge_fox(grid1, idx, proc_age, food_age);
+    omp_unset_lock(&locks[b].lock);
+    return first;
+#endif
+}
+
+// Write the cell an animal leaves (or stays at) into the output of the phase. No other
+// animal can move onto a cell of the same species, so only its own animal writes it.
+static inline void set_rabbit_source(int idx, Cell cell) {
+#ifdef LOCK_FREE
+    cells2[idx] = pack_cell(cell);
+#else
+    set_cell(grid2, idx, cell);
+#endif
+}
+
+static inline void set_fox_source(int idx, Cell cell) {
+#ifdef LOCK_FREE
+    cells1[idx] = pack_cell(cell);
+#else
+    set_cell(grid1, idx, cell);
+#endif
+}
+
+// Copy cell k of src to dst if its type is one of the two static types of the phase, empty it otherwise
+static inline void copy_static(Grid dst, Grid src, int k, int keep1, int keep2) {
+    int keep = src.type[k] == keep1 || src.type[k] == keep2;
+    dst.type[k] = keep ? src.type[k] : EMPTY;
+    dst.proc_age[k] = keep ? src.proc_age[k] : 0;
+    dst.food_age[k] = keep ? src.food_age[k] : 0;
+}
+
+// Growable list of cell indices
+typedef struct {
+    int *idx;
+    int n;
+    int cap;
+} List;
+
+static inline void list_push(List *l, int idx) {
+    if (l->n == l->cap) {
+        l->cap = l->cap ? 2 * l->cap : 1024;
+        l->idx = (int *)realloc(l->idx, (size_t)l->cap * sizeof(int));
+    }
+    l->idx[l->n++] = idx;
+}
+
+// Work-stealing deque of task indices (steal engine tiles, batch scenarios): the owner takes
+// tasks from the bottom and idle threads steal from the top of the other threads' deques. Tasks
+// are coarse, so a lock per deque is cheap; each deque sits on its own cache line.
+typedef struct {
+    omp_lock_t lock;
+    int *task;
+    int top, bottom;
+} __attribute__((aligned(64))) Deque;
+
+void deque_init(Deque *q, int capacity) {
+    omp_init_lock(&q->lock);
+    q->task = (int *)malloc((size_t)(capacity > 0 ? capacity : 1) * sizeof(int));
+    if (!q->task) {
+        fprintf(stderr, "Erro ao alocar memória\n");
+        exit(EXIT_FAILURE);
+    }
+    q->top = q->bottom = 0;
+}
+
+void deque_free(Deque *q) {
+    omp_destroy_lock(&q->lock);
+    free(q->task);
+}
+
+// Empties the deque; only between phases, when no thread is taking tasks
+void deque_clear(Deque *q) {
+    q->top = q->bottom = 0;
+}
+
+void deque_push(Deque *q, int task) {
+    omp_set_lock(&q->lock);
+    q->task[q->bottom++] = task;
+    omp_unset_lock(&q->lock);
+}
+
+// Owner side: the last task pushed, or -1 when empty
+int deque_pop(Deque *q) {
+    omp_set_lock(&q->lock);
+    int task = q->bottom > q->top ? q->task[--q->bottom] : -1;
+    omp_unset_lock(&q->lock);
+    return task;
+}
+
+// Thief side: the first task pushed, or -1 when empty
+int deque_steal(Deque *q) {
+    omp_set_lock(&q->lock);
+    int task = q->bottom > q->top ? q->task[q->top++] : -1;
+    omp_unset_lock(&q->lock);
+    return task;
+}
+
+// Next task of thread t of n: its own deque first, then the others from thread t + 1 on.
+// Nothing is pushed while the deques are drained, so -1 means every task has been taken.
+int deque_next(Deque *q, int t, int n, long long *stolen) {
+    int task = deque_pop(&q[t]);
+    for (int k = 1; task < 0 && k < n; k++) {
+        task = deque_steal(&q[(t + k) % n]);
+        if (task >= 0) (*stolen)++;
+    }
+    return task;
+}
+
+// Population time series (--series / --series-binary, push engine): the rabbit and fox loops
+// count animals, births, starvation, predation and collisions through OpenMP reductions, and the
+// master thread appends one record per generation to a buffered writer. rabbits and foxes are the
+// populations entering the generation, so the next row's populations are
+// rabbits + rabbit_births - rabbit_collisions - predation and foxes + fox_births - starved - fox_collisions.
+#define SERIES_FIELDS 9
+#define SERIES_BUF_SIZE (1 << 20)
+FILE *series_file;
+int series_binary;
+char *series_buf;
+size_t series_len;
+
+int series_open(const char *path, int binary, int append) {
+    series_file = fopen(path, append ? "ab" : "wb");
+    series_buf = (char *)malloc(SERIES_BUF_SIZE);
+    if (!series_file || !series_buf) {
+        fprintf(stderr, "Erro ao abrir %s\n", path);
+        return 0;
+    }
+    series_binary = binary;
+    if (!binary && ftell(series_file) == 0)
+        fputs("gen,rabbits,foxes,rabbit_births,fox_births,starved,predation,rabbit_collisions,fox_collisions\n", series_file);
+    return 1;
+}
+
+void series_flush() {
+    if (series_len > 0) fwrite(series_buf, 1, series_len, series_file);
+    series_len = 0;
+}
+
+// One generation: gen followed by the counters, as CSV or as SERIES_FIELDS int32 values
+void series_row(const int *v) {
+    if (series_len + 128 > SERIES_BUF_SIZE) series_flush();
+    if (series_binary) {
+        for (int k = 0; k < SERIES_FIELDS; k++) {
+            int32_t x = v[k];
+            memcpy(series_buf + series_len, &x, sizeof(x));
+            series_len += sizeof(x);
         }
-        omp_set_num_threads(n_threads);
+        return;
     }
-    else {
-        omp_set_num_threads(1); // Default to 1 thread
+    char *p = series_buf + series_len;
+    for (int k = 0; k < SERIES_FIELDS; k++) {
+        p = format_int(p, v[k]);
+        *p++ = k < SERIES_FIELDS - 1 ? ',' : '\n';
     }
+    series_len = p - series_buf;
+}
 
-    // Read input
-    if (scanf("%d %d %d %d %d %d %d", &GEN_PROC_RABBITS, &GEN_PROC_FOXES, &GEN_FOOD_FOXES, &N_GEN, &R, &C, &N) != 7) {
-        return 1;
+void series_close() {
+    if (!series_file) return;
+    series_flush();
+    fclose(series_file);
+    free(series_buf);
+    series_file = NULL;
+}
+
+// Generation trace (--trace / --trace-binary, push engine): the state entering every
+// --trace-every'th generation (and the last one) is captured inside the parallel region: the
+// threads copy the rows of the region of interest of grid1 into a free frame of a ring, with a
+// nowait loop instead of an extra barrier, and the thread that copies the last row queues the
+// frame. A writer thread formats the queued frames in order, in the layout of the allgen* files
+// (types, proc ages and food ages side by side) or as binary frames, so the compute threads only
+// stop when every frame of the ring is still waiting for the writer. The engine saturates rabbit
+// ages at GEN_PROC_RABBITS + 1, so text traces also keep, for each cell of the region, the
+// generation from which its rabbit has been saturated and print the real age from it (binary
+// frames hold the saturated planes).
+#define TRACE_SLOTS 8
+#define TRACE_RING_BYTES (1 << 30)
+
+typedef struct {
+    int gen;
+    int rows_done; // Rows copied so far
+    int ready;     // Queued for the writer
+    uint8_t *type;
+    Age *proc_age, *food_age;
+    int32_t *since; // Text traces: copy of Trace.since
+} TraceFrame;
+
+typedef struct {
+    FILE *file;
+    int binary, every;
+    int r0, c0, rows, cols; // Region of interest
+    int32_t *since;         // Text traces: first generation of each saturated rabbit (-1: unknown)
+    TraceFrame frame[TRACE_SLOTS];
+    int n_slots, head, tail, used; // Writer takes head, compute threads fill tail
+    int filling;                   // Frame of the current generation (-1: none)
+    int last_gen;                  // Last generation captured
+    int blank;                     // A blank line goes before the next text frame
+    int done;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t writer;
+    char *text;
+    long long frames, bytes;
+    double copy_s, wait_s, write_s;
+} Trace;
+
+Trace trace;
+
+// One character per cell, as in the allgen* files: ages show their last digit. The symbols of the
+// cells without a digit are looked up by type (FOX and, in the food panel, RABBIT take the digit)
+static const char trace_symbol[3][4] = {{' ', '*', 'R', 'F'}, {' ', '*', 0, 0}, {' ', '*', 'R', 0}};
+
+// Rabbit copy-back of generation gen, before grid1 is overwritten: a rabbit that stayed in cell k
+// and reached the saturated age enters generation gen + 1 with it
+static inline void trace_saturation(int k, int gen) {
+    int i = k / C - trace.r0, j = k % C - trace.c0;
+    if (i < 0 || i >= trace.rows || j < 0 || j >= trace.cols) return;
+    if (grid2.type[k] == RABBIT && grid2.proc_age[k] > GEN_PROC_RABBITS && grid1.type[k] == RABBIT &&
+        grid1.proc_age[k] == GEN_PROC_RABBITS)
+        trace.since[i * trace.cols + j] = gen + 1;
+}
+
+// since: generation of the frame for the saturated rabbit ages (proc panel), '+' when unknown
+static inline char *trace_panel(char *p, const uint8_t *type, const Age *age, const int32_t *since, int gen,
+                                int panel, int cols) {
+    const char *symbol = trace_symbol[panel];
+    *p++ = '|';
+    for (int j = 0; j < cols; j++) p[j] = symbol[type[j]] ? symbol[type[j]] : (char)('0' + age[j] % 10);
+    if (panel == 1) {
+        for (int j = 0; j < cols; j++) {
+            if (type[j] != RABBIT || age[j] <= GEN_PROC_RABBITS) continue;
+            p[j] = since[j] < 0 ? '+' : (char)('0' + (age[j] + gen - since[j]) % 10);
+        }
     }
+    p += cols;
+    *p++ = '|';
+    return p;
+}
 
-    init_grids();
+static void trace_write(const TraceFrame *f) {
+    int rows = trace.rows, cols = trace.cols;
+    if (trace.binary) {
+        // Frame: int32 gen, r0, c0, rows, cols, bytes per age, then the three planes of the region
+        int32_t h[6] = {f->gen, trace.r0, trace.c0, rows, cols, (int32_t)sizeof(Age)};
+        size_t cells = (size_t)rows * cols;
+        fwrite(h, sizeof(h), 1, trace.file);
+        fwrite(f->type, 1, cells, trace.file);
+        fwrite(f->proc_age, sizeof(Age), cells, trace.file);
+        fwrite(f->food_age, sizeof(Age), cells, trace.file);
+        trace.bytes += sizeof(h) + cells * (1 + 2 * sizeof(Age));
+        return;
+    }
+    char *p = trace.text;
+    if (trace.blank) *p++ = '\n';
+    trace.blank = 1;
+    memcpy(p, "Generation ", 11);
+    p = format_int(p + 11, f->gen);
+    *p++ = '\n';
+    for (int i = -1; i <= rows; i++) {
+        for (int panel = 0; panel < 3; panel++) {
+            if (panel > 0) {
+                int gap = panel == 1 ? 3 : 1;
+                memset(p, ' ', gap);
+                p += gap;
+            }
+            if (i < 0 || i == rows) {
+                memset(p, '-', cols + 2);
+                p += cols + 2;
+                continue;
+            }
+            size_t k = (size_t)i * cols;
+            p = trace_panel(p, f->type + k, (panel == 2 ? f->food_age : f->proc_age) + k, f->since + k, f->gen,
+                            panel, cols);
+        }
+        *p++ = '\n';
+    }
+    fwrite(trace.text, 1, p - trace.text, trace.file);
+    trace.bytes += p - trace.text;
+}
+
+// CPU time of the calling thread: on a shared core the writer's wall time also covers the compute threads
+static double thread_cpu_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-    for (int k = 0; k < N; k++) {
-        char type[10];
-        int r, c;
-        scanf("%s %d %d", type, &r, &c);
-        int idx = r * C + c;
-        if (type[0] == 'R') {
-            if (type[1] == 'O') grid1[idx].type = ROCK;
-            else grid1[idx].type = RABBIT;
+void *trace_writer(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&trace.lock);
+        while (!trace.frame[trace.head].ready && !trace.done) pthread_cond_wait(&trace.changed, &trace.lock);
+        TraceFrame *f = &trace.frame[trace.head];
+        int ready = f->ready;
+        pthread_mutex_unlock(&trace.lock);
+        if (!ready) return NULL;
+
+        double start = thread_cpu_s();
+        trace_write(f);
+        trace.frames++;
+        trace.write_s += thread_cpu_s() - start;
+
+        pthread_mutex_lock(&trace.lock);
+        f->ready = 0;
+        trace.head = (trace.head + 1) % trace.n_slots;
+        trace.used--;
+        pthread_cond_broadcast(&trace.changed);
+        pthread_mutex_unlock(&trace.lock);
+    }
+}
+
+// region: r0, c0, rows, cols of the part of the world to capture
+int trace_open(const char *path, int binary, int append, int every, const int *region) {
+    trace.file = fopen(path, append ? "ab" : "wb");
+    if (!trace.file) {
+        fprintf(stderr, "Erro ao abrir %s\n", path);
+        return 0;
+    }
+    trace.binary = binary;
+    trace.every = every;
+    trace.r0 = region[0];
+    trace.c0 = region[1];
+    trace.rows = region[2];
+    trace.cols = region[3];
+    trace.last_gen = -1;
+    trace.blank = ftell(trace.file) > 0; // Appending to the trace of a resumed run
+    pthread_mutex_init(&trace.lock, NULL);
+    pthread_cond_init(&trace.changed, NULL);
+    size_t cells = (size_t)trace.rows * trace.cols, frame_bytes = cells * (1 + 2 * sizeof(Age));
+    trace.n_slots = TRACE_SLOTS;
+    while (trace.n_slots > 2 && trace.n_slots * frame_bytes > TRACE_RING_BYTES) trace.n_slots--;
+    for (int s = 0; s < trace.n_slots; s++) {
+        TraceFrame *f = &trace.frame[s];
+        f->type = (uint8_t *)malloc(cells);
+        f->proc_age = (Age *)malloc(cells * sizeof(Age));
+        f->food_age = (Age *)malloc(cells * sizeof(Age));
+        f->since = binary ? NULL : (int32_t *)malloc(cells * sizeof(int32_t));
+        if (!f->type || !f->proc_age || !f->food_age || (!binary && !f->since)) {
+            fprintf(stderr, "Erro ao alocar memória\n");
+            return 0;
+        }
+    }
+    if (!binary) {
+        // Rabbits already saturated in a resumed state have an unknown age
+        trace.since = (int32_t *)malloc(cells * sizeof(int32_t));
+        if (!trace.since) {
+            fprintf(stderr, "Erro ao alocar memória\n");
+            return 0;
         }
-        else if (type[0] == 'F') grid1[idx].type = FOX;
+        for (size_t k = 0; k < cells; k++) trace.since[k] = -1;
     }
+    trace.text = (char *)malloc((size_t)(trace.rows + 2) * (3 * (trace.cols + 2) + 5) + 32);
+    if (!trace.text || pthread_create(&trace.writer, NULL, trace_writer, NULL) != 0) {
+        fprintf(stderr, "Erro ao alocar memória\n");
+        return 0;
+    }
+    return 1;
+}
 
-    double start_time = omp_get_wtime(); // Start timing 
+// Master thread, while the state entering gen is complete or being completed: reserves a frame
+// for gen when it is due, waiting for the writer if the ring is full
+void trace_reserve(int gen) {
+    trace.filling = -1;
+    if (!trace.file || gen <= trace.last_gen || (gen % trace.every != 0 && gen != N_GEN)) return;
+    double start = omp_get_wtime();
+    pthread_mutex_lock(&trace.lock);
+    while (trace.used == trace.n_slots) pthread_cond_wait(&trace.changed, &trace.lock);
+    trace.filling = trace.tail;
+    trace.tail = (trace.tail + 1) % trace.n_slots;
+    trace.used++;
+    pthread_mutex_unlock(&trace.lock);
+    trace.wait_s += omp_get_wtime() - start;
+    trace.frame[trace.filling].gen = gen;
+    trace.frame[trace.filling].rows_done = 0;
+    trace.last_gen = gen;
+}
 
-    int dr[] = {-1, 0, 1, 0}; // N, E, S, W
-    int dc[] = {0, 1, 0, -1};
+// All the threads, once grid1 holds the state reserved by trace_reserve: copy the region's rows
+// (no barrier at the end, grid1 and trace.since are next written after the rabbit loop's barrier)
+void trace_capture() {
+    if (!trace.file || trace.filling < 0) return;
+    TraceFrame *f = &trace.frame[trace.filling];
+    double start = omp_get_wtime();
+    int rows = 0, done;
+    #pragma omp for schedule(static) nowait
+    for (int i = 0; i < trace.rows; i++) {
+        size_t from = (size_t)(trace.r0 + i) * C + trace.c0, to = (size_t)i * trace.cols;
+        memcpy(f->type + to, grid1.type + from, trace.cols * sizeof(uint8_t));
+        memcpy(f->proc_age + to, grid1.proc_age + from, trace.cols * sizeof(Age));
+        memcpy(f->food_age + to, grid1.food_age + from, trace.cols * sizeof(Age));
+        if (trace.since) memcpy(f->since + to, trace.since + to, trace.cols * sizeof(int32_t));
+        rows++;
+    }
+    if (omp_get_thread_num() == 0) trace.copy_s += omp_get_wtime() - start;
+    #pragma omp atomic capture
+    done = f->rows_done += rows;
+    if (rows > 0 && done == trace.rows) {
+        pthread_mutex_lock(&trace.lock);
+        f->ready = 1;
+        pthread_cond_broadcast(&trace.changed);
+        pthread_mutex_unlock(&trace.lock);
+    }
+}
 
-    #pragma omp parallel
+// Waits for the writer to drain the ring
+void trace_close() {
+    if (!trace.file) return;
+    pthread_mutex_lock(&trace.lock);
+    trace.done = 1;
+    pthread_cond_broadcast(&trace.changed);
+    pthread_mutex_unlock(&trace.lock);
+    pthread_join(trace.writer, NULL);
+    if (fclose(trace.file) != 0) fprintf(stderr, "Erro ao escrever o trace\n");
+    for (int s = 0; s < trace.n_slots; s++) {
+        free(trace.frame[s].type);
+        free(trace.frame[s].proc_age);
+        free(trace.frame[s].food_age);
+        free(trace.frame[s].since);
+    }
+    free(trace.since);
+    free(trace.text);
+    trace.since = NULL;
+    pthread_mutex_destroy(&trace.lock);
+    pthread_cond_destroy(&trace.changed);
+    trace.file = NULL;
+}
+
+// The compute threads only lose the copies and the waits for a free frame, plus the writer's CPU
+// time when there is no spare core for it
+void trace_report(double elapsed_ms, int n_threads) {
+    double stall_ms = (trace.copy_s + trace.wait_s) * 1000.0;
+    int shared = n_threads >= omp_get_num_procs();
+    if (shared) stall_ms += trace.write_s * 1000.0;
+    fprintf(stderr, "Trace: %lld frames, %.1f MiB; copies %.3f ms, waits for the writer %.3f ms, writer %.3f ms%s "
+                    "(%.1f%% slower than untraced)\n", trace.frames, trace.bytes / (1024.0 * 1024.0), trace.copy_s * 1000.0,
+            trace.wait_s * 1000.0, trace.write_s * 1000.0, shared ? " on a shared core" : "",
+            elapsed_ms > stall_ms ? 100.0 * stall_ms / (elapsed_ms - stall_ms) : 0.0);
+}
+
+// Early termination (push engine): a hash of every animal (cell, species and ages) of the current
+// state is summed once at the start and then kept up to date by the copy-backs, which see the old
+// and the new content of every cell written; after each generation it is the hash of the state
+// entering the next one, whose phase mod 12 is mixed in, since the moves depend on
+// (gen + r + c) % p with p <= 4. A world
+// without animals never changes again, so the run jumps to its end. Otherwise that state is saved
+// with its hash every 12, 24, 48... generations (Brent's cycle search); when a later state in the
+// same phase has the saved hash and matches the saved copy byte for byte, the world repeats with
+// that period and whole periods are skipped. Only exact matches skip anything, so the output is that of the full
+// run. Opt-in (--early-exit): hashing every cell written costs 15-20% on worlds that never settle.
+#define PHASES 12
+enum { EARLY_NONE, EARLY_EXTINCT, EARLY_SAVE, EARLY_COMPARE };
+
+typedef struct {
+    int enabled;
+    Grid saved;         // grid1 after generation saved_gen
+    uint64_t saved_hash;
+    int saved_gen, power;
+    int differs;
+    int next_gen;
+    int stop_gen, period; // Where the first skip happened and why (period 0: no animals left)
+    long long skipped;
+} EarlyExit;
+
+EarlyExit early = {0, {NULL, NULL, NULL}, 0, 0, 0, 0, 0, -1, 0, 0};
+
+static inline uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Cell (31 bits) and species in the low bits, the ages above; a mix of the packed animal is
+// enough, since only states that also match byte for byte are skipped
+static inline uint64_t animal_hash(int idx, int type, int proc_age, int food_age) {
+    return mix64((uint64_t)idx << 2 | type | (uint64_t)proc_age << 33 | (uint64_t)food_age << 48);
+}
+
+// Hash of cell k of g: 0 unless it holds an animal
+static inline uint64_t cell_hash(Grid g, int k) {
+    int type = g.type[k];
+    return type >= RABBIT ? animal_hash(k, type, g.proc_age[k], type == FOX ? g.food_age[k] : 0) : 0;
+}
+
+// Copy-backs: what cell k going from before to after changes in the hash and the animal count
+static inline void early_delta(Grid after, Grid before, int k, uint64_t *hash, int *animals) {
+    *hash += cell_hash(after, k) - cell_hash(before, k);
+    *animals += (after.type[k] >= RABBIT) - (before.type[k] >= RABBIT);
+}
+
+// Hash of the animals of row i of grid1, counted in animals. Eight cells are tested at a time:
+// the animal types (RABBIT, FOX) are the ones with bit 1 set
+static inline uint64_t early_row_hash(int i, int *animals) {
+    const uint8_t *t = grid1.type + (size_t)i * C;
+    size_t row = (size_t)i * C;
+    uint64_t hash = 0;
+    for (int j = 0; j < C; j += 8) {
+        uint64_t w = 0;
+        if (j + 8 <= C) memcpy(&w, t + j, 8); // Little-endian: byte k is cell j + k
+        else memcpy(&w, t + j, C - j);
+        for (uint64_t m = w & 0x0202020202020202ULL; m; m &= m - 1) {
+            size_t idx = row + j + (__builtin_ctzll(m) >> 3);
+            int type = grid1.type[idx];
+            hash += animal_hash(idx, type, grid1.proc_age[idx], type == FOX ? grid1.food_age[idx] : 0);
+            (*animals)++;
+        }
+    }
+    return hash;
+}
+
+// Hash of the state entering gen + 1, the phase of gen + 1 mixed in
+static inline uint64_t early_state_hash(int gen, uint64_t hash) {
+    return hash + mix64((gen + 1) % PHASES + 1);
+}
+
+// After generation gen, with hash and animals those of grid1 (the state entering gen + 1): what to
+// do with that state. Every thread of the push engine gets the same answer
+int early_check(int gen, uint64_t hash, int animals) {
+    if (animals == 0) return EARLY_EXTINCT;
+    if (early.power > 0 && early_state_hash(gen, hash) == early.saved_hash && (gen - early.saved_gen) % PHASES == 0)
+        return EARLY_COMPARE;
+    if (early.power == 0 || gen - early.saved_gen >= early.power) return EARLY_SAVE;
+    return EARLY_NONE;
+}
+
+// All the threads of the push engine (or the seq engine alone), after generation gen when
+// early_check gave an action (grid1 and grid2 hold the state entering gen + 1); returns the next
+// generation to run
+int early_resolve(int action, int gen, int gen_to, uint64_t hash) {
+    if (action == EARLY_SAVE) {
+        #pragma omp for schedule(static)
+        for (int i = 0; i < R; i++) {
+            size_t k = (size_t)i * C;
+            memcpy(early.saved.type + k, grid1.type + k, C * sizeof(uint8_t));
+            memcpy(early.saved.proc_age + k, grid1.proc_age + k, C * sizeof(Age));
+            memcpy(early.saved.food_age + k, grid1.food_age + k, C * sizeof(Age));
+        }
+    } else if (action == EARLY_COMPARE) {
+        #pragma omp for schedule(static)
+        for (int i = 0; i < R; i++) {
+            size_t k = (size_t)i * C;
+            if (memcmp(early.saved.type + k, grid1.type + k, C * sizeof(uint8_t)) ||
+                memcmp(early.saved.proc_age + k, grid1.proc_age + k, C * sizeof(Age)) ||
+                memcmp(early.saved.food_age + k, grid1.food_age + k, C * sizeof(Age))) {
+                #pragma omp atomic write
+                early.differs = 1;
+            }
+        }
+    }
+    #pragma omp single
     {
-        for (int gen = 0; gen < N_GEN; gen++) {
-            
-            // ================= PHASE 1: RABBITS =================
-            // Input: grid1, Output: grid2
-            
-            #pragma omp for
-            for (int k = 0; k < R * C; k++) {
-                // Initialize grid2 with static elements from grid1
-                if (grid1[k].type == ROCK || grid1[k].type == FOX) {
-                    grid2[k] = grid1[k];
-                } else {
-                    grid2[k].type = EMPTY;
-                    grid2[k].proc_age = 0;
-                    grid2[k].food_age = 0;
-                }
+        int period = action == EARLY_EXTINCT ? 1 : action == EARLY_COMPARE && !early.differs ? gen - early.saved_gen : 0;
+        early.next_gen = gen + 1;
+        if (period > 0) {
+            // The state entering gen + 1 comes back every period generations
+            early.next_gen += (gen_to - gen - 1) / period * period;
+            early.skipped += early.next_gen - gen - 1;
+            if (early.stop_gen < 0) {
+                early.stop_gen = gen + 1;
+                early.period = action == EARLY_EXTINCT ? 0 : period;
             }
+        } else if (action == EARLY_SAVE) {
+            early.saved_hash = early_state_hash(gen, hash);
+            early.saved_gen = gen;
+            early.power = early.power ? 2 * early.power : PHASES;
+        }
+        early.differs = 0;
+    }
+    return early.next_gen;
+}
+
+// Engine entry of the push kernels: grid2 (and the packed mirrors) start equal to grid1
+void push_setup() {
+    init_push_state();
+#if defined(PROFILE) && !defined(LOCK_FREE)
+    profile_locks();
+#endif
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < R * C; k++) {
+        set_cell(grid2, k, get_cell(grid1, k));
+#ifdef LOCK_FREE
+        cells1[k] = cells2[k] = pack_cell(get_cell(grid1, k));
+#endif
+    }
+}
+
+// Push engine: every animal writes its destination into the output grid, serialised by
+// the lock table (or the CAS merge with -DLOCK_FREE). grid1 and grid2 hold the same state
+// between phases, so instead of rebuilding the whole output grid every phase, the kernels
+// only write the cells that change; each thread logs the cells it wrote (every target is
+// logged by its first arrival only) and copies them back into the input grid after the
+// phase. Rocks are never rewritten after load.
+void run_push(int gen_from, int gen_to) {
+    int n_threads = omp_get_max_threads();
+    List *dirty = (List *)calloc(n_threads, sizeof(List)); // Cells written by each thread
+    // Series counters of the current generation (reduction targets, read and reset by the master)
+    int rabbits = 0, rabbit_births = 0, rabbit_collisions = 0;
+    int foxes = 0, fox_births = 0, starved = 0, predation = 0, fox_collisions = 0;
+    uint64_t hash = 0; // Early termination hash and animals of grid1, updated by the copy-backs
+    int animals = 0;
+    if (early.enabled && !early.saved.type) alloc_grid(&early.saved, (size_t)R * C);
+#ifdef PROFILE
+    profile_init(n_threads);
+    double setup_start = omp_get_wtime();
+#endif
+    push_setup();
+#ifdef PROFILE
+    prof_setup += omp_get_wtime() - setup_start;
+#endif
+
+    #pragma omp parallel num_threads(n_threads)
+    {
+        uint8_t *mask = (uint8_t *)malloc(C); // Neighbour masks of the current row
+        List *written = &dirty[omp_get_thread_num()];
+        if (trace.file) {
+            // State entering the first generation
+            #pragma omp master
+            trace_reserve(gen_from);
+            #pragma omp barrier
+            trace_capture();
+        }
+        if (early.enabled) {
+            #pragma omp for schedule(static) reduction(+:hash, animals)
+            for (int i = 0; i < R; i++) hash += early_row_hash(i, &animals);
+        }
+        PROF_START();
+
+        for (int gen = gen_from; gen < gen_to; gen++) {
+
+            // ================= PHASE 1: RABBITS =================
+            // Input: grid1, Output: grid2 (equal to grid1 on entry)
 
-            #pragma omp for schedule(guided)
+            written->n = 0;
+            #pragma omp for schedule(runtime) reduction(+:rabbits, rabbit_births, rabbit_collisions) PROF_NOWAIT
             for (int i = 0; i < R; i++) {
+                if (!memchr(grid1.type + (size_t)i * C, RABBIT, C)) continue;
+                row_masks(grid1.type, i, mask);
                 for (int j = 0; j < C; j++) {
                     int idx = i * C + j;
-                    if (grid1[idx].type == RABBIT) {
-                        int current_proc_age = grid1[idx].proc_age;
-                        
-                        int possible[4];
-                        int p_count = 0;
-                        for (int k = 0; k < 4; k++) {
-                            int ni = i + dr[k];
-                            int nj = j + dc[k];
-                            if (ni >= 0 && ni < R && nj >= 0 && nj < C) {
-                                int nidx = ni * C + nj;
-                                if (grid1[nidx].type == EMPTY) {
-                                    possible[p_count++] = k;
-                                }
-                            }
-                        }
-
-                        int next_r = i, next_c = j;
-                        int moved = 0;
-
-                        if (p_count > 0) {
-                            int k = get_adjacent_index(gen, i, j, p_count);
-                            int dir = possible[k];
-                            next_r = i + dr[dir];
-                            next_c = j + dc[dir];
-                            moved = 1;
-                        }
+                    if (grid1.type[idx] == RABBIT) {
+                        PROF_COUNT(animals);
+                        rabbits++;
+                        int dir = rabbit_move(mask[j], gen, i, j);
+                        int moved = dir != STAY;
 
                         // Procreation Logic
-                        int new_proc_age = current_proc_age + 1;
+                        int new_proc_age = rabbit_age(grid1.proc_age[idx]);
                         int baby = 0;
                         if (moved && new_proc_age > GEN_PROC_RABBITS) {
                             baby = 1;
@@ -177,157 +1310,2000 @@ int main(int argc, char *argv[]) {
                         }
 
                         // Apply Move
-                        int next_idx = next_r * C + next_c;
                         if (moved) {
-                            // Move to next_r, next_c
-                            omp_set_lock(&locks[next_idx & LOCK_MASK]);
-                            solve_rabbit_conflict(&grid2[next_idx], new_proc_age);
-                            omp_unset_lock(&locks[next_idx & LOCK_MASK]);
-
-                            if (baby) {
-                                // Leave baby at old position
-                                omp_set_lock(&locks[idx & LOCK_MASK]);
-                                solve_rabbit_conflict(&grid2[idx], 0);
-                                omp_unset_lock(&locks[idx & LOCK_MASK]);
+                            // Move to the adjacent cell
+                            int next_idx = (i + dr[dir]) * C + j + dc[dir];
+                            if (place_rabbit(next_idx, new_proc_age)) list_push(written, next_idx);
+                            else {
+                                PROF_COUNT(conflicts);
+                                rabbit_collisions++;
                             }
+                            rabbit_births += baby;
+
+                            // Leave baby at old position, or empty it
+                            Cell old = {baby ? RABBIT : EMPTY, 0, 0};
+                            set_rabbit_source(idx, old);
                         } else {
                             // Stay at i, j
-                            omp_set_lock(&locks[idx & LOCK_MASK]);
-                            solve_rabbit_conflict(&grid2[idx], new_proc_age);
-                            omp_unset_lock(&locks[idx & LOCK_MASK]);
+                            Cell stay = {RABBIT, new_proc_age, 0};
+                            set_rabbit_source(idx, stay);
                         }
+                        list_push(written, idx);
                     }
                 }
             }
 
-            // ================= PHASE 2: FOXES =================
-            // Input: grid2, Output: grid1
-            
-            #pragma omp for
-            for (int k = 0; k < R * C; k++) {
-                // Initialize grid1 with static elements from grid2
-                if (grid2[k].type == ROCK || grid2[k].type == RABBIT) {
-                    grid1[k] = grid2[k];
-                } else {
-                    grid1[k].type = EMPTY;
-                    grid1[k].proc_age = 0;
-                    grid1[k].food_age = 0;
-                }
+            PROF_FOR_BARRIER(PH_RABBITS);
+
+            // Copy the cells written in grid2 back into grid1
+            uint64_t d_hash = 0;
+            int d_animals = 0;
+            for (int n = 0; n < written->n; n++) {
+                int k = written->idx[n];
+#ifdef LOCK_FREE
+                set_cell(grid2, k, unpack_cell(cells2[k]));
+                cells1[k] = cells2[k];
+#endif
+                if (early.enabled) early_delta(grid2, grid1, k, &d_hash, &d_animals);
+                if (trace.since) trace_saturation(k, gen);
+                set_cell(grid1, k, get_cell(grid2, k));
+            }
+            if (early.enabled) {
+                #pragma omp atomic
+                hash += d_hash;
+                #pragma omp atomic
+                animals += d_animals;
             }
+            PROF_BARRIER(PH_RABBITS_COPY);
 
-            #pragma omp for schedule(guided)
+            // ================= PHASE 2: FOXES =================
+            // Input: grid2, Output: grid1 (equal to grid2 on entry)
+
+            written->n = 0;
+            #pragma omp for schedule(runtime) reduction(+:foxes, fox_births, starved, predation, fox_collisions) PROF_NOWAIT
             for (int i = 0; i < R; i++) {
+                if (!memchr(grid2.type + (size_t)i * C, FOX, C)) continue;
+                row_masks(grid2.type, i, mask);
                 for (int j = 0; j < C; j++) {
                     int idx = i * C + j;
-                    if (grid2[idx].type == FOX) {
-                        int current_proc_age = grid2[idx].proc_age;
-                        int current_food_age = grid2[idx].food_age;
-
-                        int rabbit_moves[4];
-                        int r_count = 0;
-                        for (int k = 0; k < 4; k++) {
-                            int ni = i + dr[k];
-                            int nj = j + dc[k];
-                            if (ni >= 0 && ni < R && nj >= 0 && nj < C) {
-                                int nidx = ni * C + nj;
-                                if (grid2[nidx].type == RABBIT) {
-                                    rabbit_moves[r_count++] = k;
-                                }
-                            }
+                    if (grid2.type[idx] == FOX) {
+                        PROF_COUNT(animals);
+                        foxes++;
+                        list_push(written, idx);
+                        int ate;
+                        int dir = fox_move(mask[j], gen, i, j, grid2.food_age[idx], &ate);
+                        if (dir == DIE) {
+                            // Die. Empty its cell in grid1.
+                            Cell empty = {EMPTY, 0, 0};
+                            set_fox_source(idx, empty);
+                            starved++;
+                            continue;
                         }
+                        int moved = dir != STAY;
 
-                        int next_r = i, next_c = j;
-                        int moved = 0;
-                        int ate = 0;
-
-                        if (r_count > 0) {
-                            int k = get_adjacent_index(gen, i, j, r_count);
-                            int dir = rabbit_moves[k];
-                            next_r = i + dr[dir];
-                            next_c = j + dc[dir];
-                            moved = 1;
-                            ate = 1;
-                        } else {
-                            // No rabbit. Check starvation.
-                            if (current_food_age + 1 >= GEN_FOOD_FOXES) {
-                                // Die. Don't put in grid1.
-                                continue;
-                            }
-
-                            // Try to move to empty
-                            int empty_moves[4];
-                            int e_count = 0;
-                            for (int k = 0; k < 4; k++) {
-                                int ni = i + dr[k];
-                                int nj = j + dc[k];
-                                if (ni >= 0 && ni < R && nj >= 0 && nj < C) {
-                                    int nidx = ni * C + nj;
-                                    if (grid2[nidx].type == EMPTY) {
-                                        empty_moves[e_count++] = k;
-                                    }
-                                }
-                            }
-
-                            if (e_count > 0) {
-                                int k = get_adjacent_index(gen, i, j, e_count);
-                                int dir = empty_moves[k];
-                                next_r = i + dr[dir];
-                                next_c = j + dc[dir];
-                                moved = 1;
-                            }
-                        }
-
-                        // Procreation Logic
-                        int new_proc_age = current_proc_age + 1;
-                        int new_food_age = ate ? 0 : current_food_age + 1;
-                        int baby = 0;
+                        // Procreation Logic
+                        int new_proc_age = grid2.proc_age[idx] + 1;
+                        int new_food_age = ate ? 0 : grid2.food_age[idx] + 1;
+                        int baby = 0;
 
                         if (moved && new_proc_age > GEN_PROC_FOXES) {
                             baby = 1;
                             new_proc_age = 0;
                         }
 
-                        int next_idx = next_r * C + next_c;
                         if (moved) {
-                            // Move to next_r, next_c
-                            omp_set_lock(&locks[next_idx & LOCK_MASK]);
-                            solve_fox_conflict(&grid1[next_idx], new_proc_age, new_food_age);
-                            omp_unset_lock(&locks[next_idx & LOCK_MASK]);
-
-                            if (baby) {
-                                // Leave baby at old position
-                                omp_set_lock(&locks[idx & LOCK_MASK]);
-                                solve_fox_conflict(&grid1[idx], 0, 0);
-                                omp_unset_lock(&locks[idx & LOCK_MASK]);
+                            // Move to the adjacent cell
+                            int next_idx = (i + dr[dir]) * C + j + dc[dir];
+                            if (place_fox(next_idx, new_proc_age, new_food_age)) {
+                                list_push(written, next_idx);
+                                predation += ate;
+                            } else {
+                                PROF_COUNT(conflicts);
+                                fox_collisions++;
                             }
+                            fox_births += baby;
+
+                            // Leave baby at old position, or empty it
+                            Cell old = {baby ? FOX : EMPTY, 0, 0};
+                            set_fox_source(idx, old);
                         } else {
                             // Stay
-                            omp_set_lock(&locks[idx & LOCK_MASK]);
-                            solve_fox_conflict(&grid1[idx], new_proc_age, new_food_age);
-                            omp_unset_lock(&locks[idx & LOCK_MASK]);
+                            Cell stay = {FOX, new_proc_age, new_food_age};
+                            set_fox_source(idx, stay);
                         }
                     }
                 }
             }
+
+            PROF_FOR_BARRIER(PH_FOXES);
+
+            // Both reductions are complete and the next one starts after the barrier below
+            #pragma omp master
+            {
+                if (series_file) {
+                    int row[SERIES_FIELDS] = {gen, rabbits, foxes, rabbit_births, fox_births, starved, predation,
+                                              rabbit_collisions, fox_collisions};
+                    series_row(row);
+                }
+                trace_reserve(gen + 1);
+                rabbits = rabbit_births = rabbit_collisions = 0;
+                foxes = fox_births = starved = predation = fox_collisions = 0;
+            }
+
+            // Copy the cells written in grid1 back into grid2
+            d_hash = 0;
+            d_animals = 0;
+            for (int n = 0; n < written->n; n++) {
+                int k = written->idx[n];
+#ifdef LOCK_FREE
+                set_cell(grid1, k, unpack_cell(cells1[k]));
+                cells2[k] = cells1[k];
+#endif
+                if (early.enabled) early_delta(grid1, grid2, k, &d_hash, &d_animals);
+                set_cell(grid2, k, get_cell(grid1, k));
+            }
+            if (early.enabled) {
+                #pragma omp atomic
+                hash += d_hash;
+                #pragma omp atomic
+                animals += d_animals;
+            }
+            PROF_BARRIER(PH_FOXES_COPY);
+            PROF_REPORT(gen + 1);
+            trace_capture();
+            if (early.enabled) {
+                // hash and animals change again only after the next rabbit loop's barrier
+                int action = early_check(gen, hash, animals);
+                if (action) gen = early_resolve(action, gen, gen_to, hash) - 1;
+            }
         }
+        free(mask);
     }
-    double end_time = omp_get_wtime(); // End timing
-    double elapsed_ms = ((double)(end_time - start_time)) * 1000.0;
-    // Print Output
-    int count = 0;
-    for(int i=0; i<R*C; i++) if(grid1[i].type != EMPTY) count++;
-    
-    printf("%d %d %d %d %d %d %d\n", GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES, 0, R, C, count);
 
-    for (int i = 0; i < R; i++) {
+    for (int k = 0; k < n_threads; k++) free(dirty[k].idx);
+    free(dirty);
+}
+
+// Sequential engine: the push kernels on the calling thread, without locks, atomics or the
+// thread team. grid2 starts equal to grid1, the animals are merged straight into the output grid
+// and the cells written are copied back after each phase; early termination as in run_push.
+void run_seq(int gen_from, int gen_to) {
+    List written = {NULL, 0, 0};
+    uint8_t *mask = (uint8_t *)malloc(C); // Neighbour masks of the current row
+    if (early.enabled && !early.saved.type) alloc_grid(&early.saved, (size_t)R * C);
+    memcpy(grid2.type, grid1.type, (size_t)R * C * sizeof(uint8_t));
+    memcpy(grid2.proc_age, grid1.proc_age, (size_t)R * C * sizeof(Age));
+    memcpy(grid2.food_age, grid1.food_age, (size_t)R * C * sizeof(Age));
+    // Early termination hash and animals of grid1, updated by the copy-backs (a cell written twice
+    // changes nothing the second time)
+    uint64_t hash = 0;
+    int animals = 0;
+    if (early.enabled)
+        for (int i = 0; i < R; i++) hash += early_row_hash(i, &animals);
+
+    for (int gen = gen_from; gen < gen_to; gen++) {
+
+        // ================= PHASE 1: RABBITS =================
+        // Input: grid1, Output: grid2 (equal to grid1 on entry)
+
+        written.n = 0;
+        for (int i = 0; i < R; i++) {
+            if (!memchr(grid1.type + (size_t)i * C, RABBIT, C)) continue;
+            row_masks(grid1.type, i, mask);
+            for (int j = 0; j < C; j++) {
+                int idx = i * C + j;
+                if (grid1.type[idx] != RABBIT) continue;
+                int dir = rabbit_move(mask[j], gen, i, j);
+                int new_proc_age = rabbit_age(grid1.proc_age[idx]);
+                list_push(&written, idx);
+                if (dir == STAY) {
+                    Cell stay = {RABBIT, new_proc_age, 0};
+                    set_cell(grid2, idx, stay);
+                    continue;
+                }
+                int baby = new_proc_age > GEN_PROC_RABBITS;
+                if (baby) new_proc_age = 0;
+                int next_idx = (i + dr[dir]) * C + j + dc[dir];
+                merge_rabbit(grid2, next_idx, new_proc_age);
+                list_push(&written, next_idx);
+                // Leave baby at old position, or empty it
+                Cell old = {baby ? RABBIT : EMPTY, 0, 0};
+                set_cell(grid2, idx, old);
+            }
+        }
+        for (int n = 0; n < written.n; n++) {
+            if (early.enabled) early_delta(grid2, grid1, written.idx[n], &hash, &animals);
+            set_cell(grid1, written.idx[n], get_cell(grid2, written.idx[n]));
+        }
+
+        // ================= PHASE 2: FOXES =================
+        // Input: grid2, Output: grid1 (equal to grid2 on entry)
+
+        written.n = 0;
+        for (int i = 0; i < R; i++) {
+            if (!memchr(grid2.type + (size_t)i * C, FOX, C)) continue;
+            row_masks(grid2.type, i, mask);
+            for (int j = 0; j < C; j++) {
+                int idx = i * C + j;
+                if (grid2.type[idx] != FOX) continue;
+                int ate;
+                int dir = fox_move(mask[j], gen, i, j, grid2.food_age[idx], &ate);
+                list_push(&written, idx);
+                if (dir == DIE) {
+                    Cell empty = {EMPTY, 0, 0};
+                    set_cell(grid1, idx, empty);
+                    continue;
+                }
+                int new_proc_age = grid2.proc_age[idx] + 1;
+                int new_food_age = ate ? 0 : grid2.food_age[idx] + 1;
+                if (dir == STAY) {
+                    Cell stay = {FOX, new_proc_age, new_food_age};
+                    set_cell(grid1, idx, stay);
+                    continue;
+                }
+                int baby = new_proc_age > GEN_PROC_FOXES;
+                if (baby) new_proc_age = 0;
+                int next_idx = (i + dr[dir]) * C + j + dc[dir];
+                merge_fox(grid1, next_idx, new_proc_age, new_food_age);
+                list_push(&written, next_idx);
+                // Leave baby at old position, or empty it
+                Cell old = {baby ? FOX : EMPTY, 0, 0};
+                set_cell(grid1, idx, old);
+            }
+        }
+        for (int n = 0; n < written.n; n++) {
+            if (early.enabled) early_delta(grid1, grid2, written.idx[n], &hash, &animals);
+            set_cell(grid2, written.idx[n], get_cell(grid1, written.idx[n]));
+        }
+        if (!early.enabled) continue;
+        int action = early_check(gen, hash, animals);
+        if (action) gen = early_resolve(action, gen, gen_to, hash) - 1;
+    }
+    free(mask);
+    free(written.idx);
+}
+
+// Gather kernels: cell (i, j) of the output of a phase, from the input grid and the moves mv[]
+// of its animals (indexed like the grid). Neighbour k arrives when it moves in direction
+// (k + 2) % 4. Only the outer ring of the grid has neighbours outside it: the row functions run
+// the interior cells with edge = 0, a constant that unrolls the four probes without bounds
+// checks, and the first and last row and column with edge = 1.
+static inline void rabbit_arrival(const signed char *mv, int nidx, int dir, Cell *cell) {
+    if (grid1.type[nidx] == RABBIT && mv[nidx] == dir) {
+        int new_proc_age = rabbit_age(grid1.proc_age[nidx]);
+        if (new_proc_age > GEN_PROC_RABBITS) new_proc_age = 0;
+        solve_rabbit_conflict(cell, new_proc_age);
+    }
+}
+
+static inline void fox_arrival(const signed char *mv, int nidx, int dir, int ate, Cell *cell) {
+    if (grid2.type[nidx] == FOX && mv[nidx] == dir) {
+        int new_proc_age = grid2.proc_age[nidx] + 1;
+        if (new_proc_age > GEN_PROC_FOXES) new_proc_age = 0;
+        solve_fox_conflict(cell, new_proc_age, ate ? 0 : grid2.food_age[nidx] + 1);
+    }
+}
+
+// Rabbit phase: grid1 -> grid2
+static inline void gather_rabbit_cell(const signed char *mv, int i, int j, const int edge) {
+    int idx = i * C + j;
+    Cell cell = {EMPTY, 0, 0};
+    int type = grid1.type[idx];
+    if (type == ROCK || type == FOX) {
+        cell = get_cell(grid1, idx);
+    } else if (type == RABBIT) {
+        // Own rabbit: stays, or leaves a baby behind
+        int new_proc_age = rabbit_age(grid1.proc_age[idx]);
+        if (mv[idx] == STAY) solve_rabbit_conflict(&cell, new_proc_age);
+        else if (new_proc_age > GEN_PROC_RABBITS) solve_rabbit_conflict(&cell, 0);
+    } else {
+        // Empty cell: rabbits of the neighbours moving into it
+        if (!edge || i > 0) rabbit_arrival(mv, idx - C, 2, &cell);
+        if (!edge || j < C - 1) rabbit_arrival(mv, idx + 1, 3, &cell);
+        if (!edge || i < R - 1) rabbit_arrival(mv, idx + C, 0, &cell);
+        if (!edge || j > 0) rabbit_arrival(mv, idx - 1, 1, &cell);
+    }
+    set_cell(grid2, idx, cell);
+}
+
+// Fox phase: grid2 -> grid1
+static inline void gather_fox_cell(const signed char *mv, int i, int j, const int edge) {
+    int idx = i * C + j;
+    Cell cell = {EMPTY, 0, 0};
+    int type = grid2.type[idx];
+    if (type == ROCK) {
+        set_cell(grid1, idx, get_cell(grid2, idx));
+        return;
+    }
+    if (type == RABBIT) {
+        cell = get_cell(grid2, idx);
+    } else if (type == FOX) {
+        // Own fox: stays, or leaves a baby behind (DIE leaves the cell empty)
+        if (mv[idx] == STAY) solve_fox_conflict(&cell, grid2.proc_age[idx] + 1, grid2.food_age[idx] + 1);
+        else if (mv[idx] != DIE && grid2.proc_age[idx] + 1 > GEN_PROC_FOXES) solve_fox_conflict(&cell, 0, 0);
+    }
+    if (type != FOX) {
+        // Empty or rabbit cell: foxes of the neighbours moving into it
+        int ate = type == RABBIT;
+        if (!edge || i > 0) fox_arrival(mv, idx - C, 2, ate, &cell);
+        if (!edge || j < C - 1) fox_arrival(mv, idx + 1, 3, ate, &cell);
+        if (!edge || i < R - 1) fox_arrival(mv, idx + C, 0, ate, &cell);
+        if (!edge || j > 0) fox_arrival(mv, idx - 1, 1, ate, &cell);
+    }
+    set_cell(grid1, idx, cell);
+}
+
+static inline void gather_rabbit_row(const signed char *mv, int i) {
+    if (i == 0 || i == R - 1 || C < 3) {
+        for (int j = 0; j < C; j++) gather_rabbit_cell(mv, i, j, 1);
+        return;
+    }
+    gather_rabbit_cell(mv, i, 0, 1);
+    for (int j = 1; j < C - 1; j++) gather_rabbit_cell(mv, i, j, 0);
+    gather_rabbit_cell(mv, i, C - 1, 1);
+}
+
+static inline void gather_fox_row(const signed char *mv, int i) {
+    if (i == 0 || i == R - 1 || C < 3) {
+        for (int j = 0; j < C; j++) gather_fox_cell(mv, i, j, 1);
+        return;
+    }
+    gather_fox_cell(mv, i, 0, 1);
+    for (int j = 1; j < C - 1; j++) gather_fox_cell(mv, i, j, 0);
+    gather_fox_cell(mv, i, C - 1, 1);
+}
+
+// Gather engine: every animal first records the direction it moves to in moves[],
+// then every cell pulls the animals that arrive at it from its own position and its
+// 4 neighbours and resolves the conflicts locally. Each thread only writes the cells
+// it owns, so no locks or atomics are needed.
+void run_gather(int gen_from, int gen_to) {
+    #pragma omp parallel
+    {
+        uint8_t *mask = (uint8_t *)malloc(C); // Neighbour masks of the current row
+
+        for (int gen = gen_from; gen < gen_to; gen++) {
+
+            // ================= PHASE 1: RABBITS =================
+            // Input: grid1, Output: grid2
+
+            #pragma omp for schedule(runtime)
+            for (int i = 0; i < R; i++) {
+                if (!memchr(grid1.type + (size_t)i * C, RABBIT, C)) continue;
+                row_masks(grid1.type, i, mask);
+                for (int j = 0; j < C; j++) {
+                    int idx = i * C + j;
+                    if (grid1.type[idx] == RABBIT) moves[idx] = (signed char)rabbit_move(mask[j], gen, i, j);
+                }
+            }
+
+            #pragma omp for schedule(static)
+            for (int i = 0; i < R; i++) gather_rabbit_row(moves, i);
+
+            // ================= PHASE 2: FOXES =================
+            // Input: grid2, Output: grid1
+
+            #pragma omp for schedule(runtime)
+            for (int i = 0; i < R; i++) {
+                if (!memchr(grid2.type + (size_t)i * C, FOX, C)) continue;
+                row_masks(grid2.type, i, mask);
+                for (int j = 0; j < C; j++) {
+                    int idx = i * C + j;
+                    if (grid2.type[idx] == FOX) {
+                        int ate;
+                        moves[idx] = (signed char)fox_move(mask[j], gen, i, j, grid2.food_age[idx], &ate);
+                    }
+                }
+            }
+
+            #pragma omp for schedule(static)
+            for (int i = 0; i < R; i++) gather_fox_row(moves, i);
+        }
+        free(mask);
+    }
+}
+
+// Band engine helper: grid and index written for cell (r, c) by the band [lo, hi). Rows just
+// outside the band go to the band's private halo rows, which the neighbouring band merges afterwards.
+static inline Grid band_target(Grid out, Grid halo, int lo, int hi, int r, int c, int *idx) {
+    if (r < lo) { *idx = c; return halo; }
+    if (r >= hi) { *idx = C + c; return halo; }
+    *idx = r * C + c;
+    return out;
+}
+
+// Band engine: each thread owns a fixed contiguous band of rows for the whole run and
+// updates it without synchronisation. Moves leaving the band are written to the band's
+// two halo rows and merged by the owner of those rows after the phase, so the only
+// synchronisation left is two barriers per phase and O(threads x C) merge work.
+// As in the push engine, grid1 and grid2 hold the same state between phases and each
+// thread copies back the cells of its band it wrote.
+void run_band(int gen_from, int gen_to) {
+    int n_bands = omp_get_max_threads();
+    if (n_bands > R) n_bands = R; // Every band holds at least one row
+    Grid halos;
+    alloc_grid(&halos, (size_t)n_bands * 2 * C);
+    List *dirty = (List *)calloc(n_bands, sizeof(List)); // Cells written by each band
+
+    #pragma omp parallel for schedule(static)
+    for (int k = 0; k < R * C; k++) set_cell(grid2, k, get_cell(grid1, k));
+
+    #pragma omp parallel num_threads(n_bands)
+    {
+        int t = omp_get_thread_num();
+        int lo = t * R / n_bands;
+        int hi = (t + 1) * R / n_bands;
+        // Row lo - 1 (owned by band t - 1) followed by row hi (owned by band t + 1)
+        Grid halo = {halos.type + (size_t)2 * t * C, halos.proc_age + (size_t)2 * t * C, halos.food_age + (size_t)2 * t * C};
+        // Bottom halo row of band t - 1 and top halo row of band t + 1
+        int from_above = (2 * t - 1) * C;
+        int from_below = (2 * t + 2) * C;
+        uint8_t *mask = (uint8_t *)malloc(C); // Neighbour masks of the current row
+        List *written = &dirty[t];
+        Cell empty = {EMPTY, 0, 0};
+
+        for (int gen = gen_from; gen < gen_to; gen++) {
+
+            // ================= PHASE 1: RABBITS =================
+            // Input: grid1, Output: grid2 (equal to grid1 on entry)
+
+            written->n = 0;
+            memset(halo.type, EMPTY, 2 * C);
+
+            for (int i = lo; i < hi; i++) {
+                if (!memchr(grid1.type + (size_t)i * C, RABBIT, C)) continue;
+                row_masks(grid1.type, i, mask);
+                for (int j = 0; j < C; j++) {
+                    int idx = i * C + j;
+                    if (grid1.type[idx] == RABBIT) {
+                        int dir = rabbit_move(mask[j], gen, i, j);
+                        int new_proc_age = rabbit_age(grid1.proc_age[idx]);
+                        list_push(written, idx);
+                        if (dir == STAY) {
+                            Cell stay = {RABBIT, new_proc_age, 0};
+                            set_cell(grid2, idx, stay);
+                            continue;
+                        }
+                        if (new_proc_age > GEN_PROC_RABBITS) {
+                            // Leave baby at old position
+                            Cell baby = {RABBIT, 0, 0};
+                            new_proc_age = 0;
+                            set_cell(grid2, idx, baby);
+                        } else {
+                            set_cell(grid2, idx, empty);
+                        }
+                        int next_idx;
+                        Grid out = band_target(grid2, halo, lo, hi, i + dr[dir], j + dc[dir], &next_idx);
+                        merge_rabbit(out, next_idx, new_proc_age);
+                        if (out.type == grid2.type) list_push(written, next_idx);
+                    }
+                }
+            }
+            #pragma omp barrier
+
+            // Merge the halo rows of the neighbouring bands into the first and last rows
+            if (t > 0) {
+                for (int j = 0; j < C; j++) {
+                    if (halos.type[from_above + j] == RABBIT) {
+                        merge_rabbit(grid2, lo * C + j, halos.proc_age[from_above + j]);
+                        list_push(written, lo * C + j);
+                    }
+                }
+            }
+            if (t < n_bands - 1) {
+                for (int j = 0; j < C; j++) {
+                    if (halos.type[from_below + j] == RABBIT) {
+                        merge_rabbit(grid2, (hi - 1) * C + j, halos.proc_age[from_below + j]);
+                        list_push(written, (hi - 1) * C + j);
+                    }
+                }
+            }
+            // Copy the cells written in grid2 back into grid1 (all of them in this band)
+            for (int n = 0; n < written->n; n++) set_cell(grid1, written->idx[n], get_cell(grid2, written->idx[n]));
+            #pragma omp barrier
+
+            // ================= PHASE 2: FOXES =================
+            // Input: grid2, Output: grid1 (equal to grid2 on entry)
+
+            written->n = 0;
+            memset(halo.type, EMPTY, 2 * C);
+
+            for (int i = lo; i < hi; i++) {
+                if (!memchr(grid2.type + (size_t)i * C, FOX, C)) continue;
+                row_masks(grid2.type, i, mask);
+                for (int j = 0; j < C; j++) {
+                    int idx = i * C + j;
+                    if (grid2.type[idx] == FOX) {
+                        int ate;
+                        int dir = fox_move(mask[j], gen, i, j, grid2.food_age[idx], &ate);
+                        list_push(written, idx);
+                        if (dir == DIE) {
+                            set_cell(grid1, idx, empty);
+                            continue;
+                        }
+                        int new_proc_age = grid2.proc_age[idx] + 1;
+                        int new_food_age = ate ? 0 : grid2.food_age[idx] + 1;
+                        if (dir == STAY) {
+                            Cell stay = {FOX, new_proc_age, new_food_age};
+                            set_cell(grid1, idx, stay);
+                            continue;
+                        }
+                        if (new_proc_age > GEN_PROC_FOXES) {
+                            // Leave baby at old position
+                            Cell baby = {FOX, 0, 0};
+                            new_proc_age = 0;
+                            set_cell(grid1, idx, baby);
+                        } else {
+                            set_cell(grid1, idx, empty);
+                        }
+                        int next_idx;
+                        Grid out = band_target(grid1, halo, lo, hi, i + dr[dir], j + dc[dir], &next_idx);
+                        merge_fox(out, next_idx, new_proc_age, new_food_age);
+                        if (out.type == grid1.type) list_push(written, next_idx);
+                    }
+                }
+            }
+            #pragma omp barrier
+
+            if (t > 0) {
+                for (int j = 0; j < C; j++) {
+                    if (halos.type[from_above + j] == FOX) {
+                        merge_fox(grid1, lo * C + j, halos.proc_age[from_above + j], halos.food_age[from_above + j]);
+                        list_push(written, lo * C + j);
+                    }
+                }
+            }
+            if (t < n_bands - 1) {
+                for (int j = 0; j < C; j++) {
+                    if (halos.type[from_below + j] == FOX) {
+                        merge_fox(grid1, (hi - 1) * C + j, halos.proc_age[from_below + j], halos.food_age[from_below + j]);
+                        list_push(written, (hi - 1) * C + j);
+                    }
+                }
+            }
+            // Copy the cells written in grid1 back into grid2
+            for (int n = 0; n < written->n; n++) set_cell(grid2, written->idx[n], get_cell(grid1, written->idx[n]));
+            #pragma omp barrier
+        }
+        free(mask);
+    }
+
+    for (int k = 0; k < n_bands; k++) free(dirty[k].idx);
+    free(dirty);
+    free_grid(&halos);
+}
+
+// Sparse engine helper: the arrivals at cell t of the animals of src that point at it in moves[].
+// Returns the index of the first arriving neighbour (the one that writes t) and merges
+// every arrival into *cell.
+static inline int sparse_arrivals(Grid src, int type, int t, Cell *cell) {
+    int i = t / C, j = t % C;
+    int writer = -1;
+    for (int k = 0; k < 4; k++) {
+        int ni = i + dr[k];
+        int nj = j + dc[k];
+        if (ni < 0 || ni >= R || nj < 0 || nj >= C) continue;
+        int nidx = ni * C + nj;
+        if (src.type[nidx] != type || moves[nidx] != (k + 2) % 4) continue;
+        if (writer < 0) writer = nidx;
+        if (type == RABBIT) {
+            int new_proc_age = rabbit_age(src.proc_age[nidx]);
+            solve_rabbit_conflict(cell, new_proc_age > GEN_PROC_RABBITS ? 0 : new_proc_age);
+        } else {
+            int new_proc_age = src.proc_age[nidx] + 1;
+            int ate = src.type[t] == RABBIT;
+            solve_fox_conflict(cell, new_proc_age > GEN_PROC_FOXES ? 0 : new_proc_age, ate ? 0 : src.food_age[nidx] + 1);
+        }
+    }
+    return writer;
+}
+
+// Concatenate the per-thread lists into list (called by every thread of the team)
+static void sparse_gather_lists(List *list, List *parts, int *offsets) {
+    int t = omp_get_thread_num();
+    #pragma omp single
+    {
+        int n = 0;
+        for (int k = 0; k < omp_get_num_threads(); k++) {
+            offsets[k] = n;
+            n += parts[k].n;
+        }
+        list->n = n;
+    }
+    memcpy(list->idx + offsets[t], parts[t].idx, (size_t)parts[t].n * sizeof(int));
+}
+
+// Sparse engine: keeps a list of the cells holding rabbits and one of the cells holding
+// foxes, so the work per generation is proportional to the number of animals. grid1 and
+// grid2 are kept identical between phases: a phase only writes the cells its animals
+// leave or arrive at in the output grid, and those cells are then copied back into the
+// input grid. Conflicts are resolved like in the gather engine: every target cell is
+// written by exactly one of the animals arriving at it, so no locks or atomics are needed.
+void run_sparse(int gen_from, int gen_to) {
+    int n_threads = omp_get_max_threads();
+    List rabbits = {(int *)malloc((size_t)R * C * sizeof(int)), 0, R * C};
+    List foxes = {(int *)malloc((size_t)R * C * sizeof(int)), 0, R * C};
+    List *parts = (List *)calloc(n_threads, sizeof(List)); // New animals found by each thread
+    List *dirty = (List *)calloc(n_threads, sizeof(List)); // Cells written by each thread
+    int *offsets = (int *)malloc(n_threads * sizeof(int));
+
+    for (int k = 0; k < R * C; k++) {
+        set_cell(grid2, k, get_cell(grid1, k));
+        if (grid1.type[k] == RABBIT) rabbits.idx[rabbits.n++] = k;
+        else if (grid1.type[k] == FOX) foxes.idx[foxes.n++] = k;
+    }
+
+    #pragma omp parallel num_threads(n_threads)
+    {
+        int t = omp_get_thread_num();
+        List *out = &parts[t];
+        List *written = &dirty[t];
+
+        for (int gen = gen_from; gen < gen_to; gen++) {
+
+            // ================= PHASE 1: RABBITS =================
+            // Input: grid1, Output: grid2 (equal to grid1 on entry)
+            // Entries of eaten rabbits are still in the list and are dropped here.
+
+            #pragma omp for schedule(static)
+            for (int n = 0; n < rabbits.n; n++) {
+                int idx = rabbits.idx[n];
+                if (grid1.type[idx] == RABBIT)
+                    moves[idx] = (signed char)rabbit_move(cell_mask(grid1.type, idx / C, idx % C), gen, idx / C, idx % C);
+            }
+
+            out->n = written->n = 0;
+            #pragma omp for schedule(static)
+            for (int n = 0; n < rabbits.n; n++) {
+                int idx = rabbits.idx[n];
+                if (grid1.type[idx] != RABBIT) continue;
+                int dir = moves[idx];
+                int new_proc_age = rabbit_age(grid1.proc_age[idx]);
+                Cell cell = {EMPTY, 0, 0};
+                if (dir == STAY) solve_rabbit_conflict(&cell, new_proc_age);
+                else if (new_proc_age > GEN_PROC_RABBITS) solve_rabbit_conflict(&cell, 0); // Baby
+                set_cell(grid2, idx, cell);
+                list_push(written, idx);
+                if (cell.type == RABBIT) list_push(out, idx);
+
+                if (dir != STAY) {
+                    int next_idx = (idx / C + dr[dir]) * C + idx % C + dc[dir];
+                    Cell arrived = {EMPTY, 0, 0};
+                    if (sparse_arrivals(grid1, RABBIT, next_idx, &arrived) == idx) {
+                        set_cell(grid2, next_idx, arrived);
+                        list_push(written, next_idx);
+                        list_push(out, next_idx);
+                    }
+                }
+            }
+
+            sparse_gather_lists(&rabbits, parts, offsets);
+            for (int n = 0; n < written->n; n++) set_cell(grid1, written->idx[n], get_cell(grid2, written->idx[n]));
+            #pragma omp barrier
+
+            // ================= PHASE 2: FOXES =================
+            // Input: grid2, Output: grid1 (equal to grid2 on entry)
+
+            #pragma omp for schedule(static)
+            for (int n = 0; n < foxes.n; n++) {
+                int idx = foxes.idx[n];
+                int ate;
+                moves[idx] = (signed char)fox_move(cell_mask(grid2.type, idx / C, idx % C), gen, idx / C, idx % C,
+                                                   grid2.food_age[idx], &ate);
+            }
+
+            out->n = written->n = 0;
+            #pragma omp for schedule(static)
+            for (int n = 0; n < foxes.n; n++) {
+                int idx = foxes.idx[n];
+                int dir = moves[idx];
+                Cell cell = {EMPTY, 0, 0};
+                if (dir == STAY) solve_fox_conflict(&cell, grid2.proc_age[idx] + 1, grid2.food_age[idx] + 1);
+                else if (dir != DIE && grid2.proc_age[idx] + 1 > GEN_PROC_FOXES) solve_fox_conflict(&cell, 0, 0); // Baby
+                set_cell(grid1, idx, cell);
+                list_push(written, idx);
+                if (cell.type == FOX) list_push(out, idx);
+
+                if (dir >= 0) {
+                    int next_idx = (idx / C + dr[dir]) * C + idx % C + dc[dir];
+                    Cell arrived = {EMPTY, 0, 0};
+                    if (sparse_arrivals(grid2, FOX, next_idx, &arrived) == idx) {
+                        set_cell(grid1, next_idx, arrived);
+                        list_push(written, next_idx);
+                        list_push(out, next_idx);
+                    }
+                }
+            }
+
+            sparse_gather_lists(&foxes, parts, offsets);
+            for (int n = 0; n < written->n; n++) set_cell(grid2, written->idx[n], get_cell(grid1, written->idx[n]));
+            #pragma omp barrier
+        }
+    }
+
+    for (int k = 0; k < n_threads; k++) {
+        free(parts[k].idx);
+        free(dirty[k].idx);
+    }
+    free(parts);
+    free(dirty);
+    free(offsets);
+    free(rabbits.idx);
+    free(foxes.idx);
+}
+
+// Tile engine helper: neighbour mask of cell idx of a local buffer with cols columns, whose
+// outermost ring is ROCK, so no bounds checks are needed for the cells inside it
+static inline uint8_t local_mask(const uint8_t *type, int cols, int idx) {
+    return type_bits(type[idx - cols], 0) | type_bits(type[idx + 1], 1) |
+           type_bits(type[idx + cols], 2) | type_bits(type[idx - 1], 3);
+}
+
+// Tile engine helper: one generation of the rows x cols local buffer a (its own scratch
+// buffer b), whose cell (0, 0) is the cell (r0, c0) of the world. Result left in a.
+// The breeding and starvation ages come from rules (batch scenarios each have their own).
+static void local_generation(Grid a, Grid b, int rows, int cols, int r0, int c0, int gen, Rules rules) {
+    for (int k = 0; k < rows * cols; k++) copy_static(b, a, k, ROCK, FOX);
+    for (int li = 1; li < rows - 1; li++) {
+        for (int lj = 1; lj < cols - 1; lj++) {
+            int idx = li * cols + lj;
+            if (a.type[idx] != RABBIT) continue;
+            int dir = rabbit_move(local_mask(a.type, cols, idx), gen, r0 + li, c0 + lj);
+            int new_proc_age = a.proc_age[idx] > rules.proc_rabbits ? a.proc_age[idx] : a.proc_age[idx] + 1;
+            if (dir == STAY) {
+                merge_rabbit(b, idx, new_proc_age);
+                continue;
+            }
+            if (new_proc_age > rules.proc_rabbits) {
+                // Leave baby at old position
+                new_proc_age = 0;
+                merge_rabbit(b, idx, 0);
+            }
+            merge_rabbit(b, idx + dr[dir] * cols + dc[dir], new_proc_age);
+        }
+    }
+
+    for (int k = 0; k < rows * cols; k++) copy_static(a, b, k, ROCK, RABBIT);
+    for (int li = 1; li < rows - 1; li++) {
+        for (int lj = 1; lj < cols - 1; lj++) {
+            int idx = li * cols + lj;
+            if (b.type[idx] != FOX) continue;
+            int ate;
+            int dir = fox_move_rules(local_mask(b.type, cols, idx), gen, r0 + li, c0 + lj, b.food_age[idx],
+                                     rules.food_foxes, &ate);
+            if (dir == DIE) continue;
+            int new_proc_age = b.proc_age[idx] + 1;
+            int new_food_age = ate ? 0 : b.food_age[idx] + 1;
+            if (dir == STAY) {
+                merge_fox(a, idx, new_proc_age, new_food_age);
+                continue;
+            }
+            if (new_proc_age > rules.proc_foxes) {
+                // Leave baby at old position
+                new_proc_age = 0;
+                merge_fox(a, idx, 0, 0);
+            }
+            merge_fox(a, idx + dr[dir] * cols + dc[dir], new_proc_age, new_food_age);
+        }
+    }
+}
+
+// Tile engine (temporal blocking): the world is cut into TILE_SIZE x TILE_SIZE tiles (at most R x C) and
+// each tile is advanced TILE_GENS generations at a time in a private, cache-resident
+// buffer. A cell depends on cells at most 2 away per phase, so the buffer holds the tile
+// plus a halo of 4 * TILE_GENS cells (and a ROCK ring that stands for the unknown cells
+// beyond it, or for the outside of the world); after TILE_GENS generations the tile
+// itself is exact and is written to grid2. The halo is recomputed redundantly by the
+// neighbouring tiles, trading extra compute for one pass over the world per block.
+int TILE_SIZE = 128, TILE_GENS = 2;
+
+void run_tile(int gen_from, int gen_to) {
+    int halo = 4 * TILE_GENS;
+    int tile_r = TILE_SIZE < R ? TILE_SIZE : R;
+    int tile_c = TILE_SIZE < C ? TILE_SIZE : C;
+    int rows = tile_r + 2 * halo + 2;
+    int cols = tile_c + 2 * halo + 2;
+    int tiles_r = (R + tile_r - 1) / tile_r;
+    int tiles_c = (C + tile_c - 1) / tile_c;
+    Rules rules = {GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES};
+
+    #pragma omp parallel
+    {
+        Grid a, b;
+        alloc_grid(&a, (size_t)rows * cols);
+        alloc_grid(&b, (size_t)rows * cols);
+
+        for (int gen = gen_from; gen < gen_to; gen += TILE_GENS) {
+            int n_gens = gen_to - gen < TILE_GENS ? gen_to - gen : TILE_GENS;
+
+            #pragma omp for schedule(dynamic)
+            for (int tile = 0; tile < tiles_r * tiles_c; tile++) {
+                // World coordinates of local cell (0, 0)
+                int r0 = (tile / tiles_c) * tile_r - halo - 1;
+                int c0 = (tile % tiles_c) * tile_c - halo - 1;
+                // Load the tile and its halo; cells outside the world and the outer ring are ROCK
+                memset(a.type, ROCK, (size_t)rows * cols);
+                memset(a.proc_age, 0, (size_t)rows * cols * sizeof(Age));
+                memset(a.food_age, 0, (size_t)rows * cols * sizeof(Age));
+                int c_from = c0 + 1 > 0 ? c0 + 1 : 0;
+                int c_to = c0 + cols - 1 < C ? c0 + cols - 1 : C;
+                for (int li = 1; li < rows - 1; li++) {
+                    int r = r0 + li;
+                    if (r < 0 || r >= R) continue;
+                    size_t from = (size_t)r * C + c_from, to = (size_t)li * cols + (c_from - c0);
+                    memcpy(a.type + to, grid1.type + from, (c_to - c_from) * sizeof(uint8_t));
+                    memcpy(a.proc_age + to, grid1.proc_age + from, (c_to - c_from) * sizeof(Age));
+                    memcpy(a.food_age + to, grid1.food_age + from, (c_to - c_from) * sizeof(Age));
+                }
+
+                for (int g = 0; g < n_gens; g++) local_generation(a, b, rows, cols, r0, c0, gen + g, rules);
+
+                for (int li = halo + 1; li < halo + 1 + tile_r && r0 + li < R; li++) {
+                    int r = r0 + li;
+                    int lj = halo + 1;
+                    int n = C - (c0 + lj) < tile_c ? C - (c0 + lj) : tile_c;
+                    memcpy(grid2.type + (size_t)r * C + c0 + lj, a.type + li * cols + lj, n * sizeof(uint8_t));
+                    memcpy(grid2.proc_age + (size_t)r * C + c0 + lj, a.proc_age + li * cols + lj, n * sizeof(Age));
+                    memcpy(grid2.food_age + (size_t)r * C + c0 + lj, a.food_age + li * cols + lj, n * sizeof(Age));
+                }
+            }
+
+            #pragma omp single
+            {
+                Grid swap = grid1;
+                grid1 = grid2;
+                grid2 = swap;
+            }
+        }
+        free_grid(&a);
+        free_grid(&b);
+    }
+}
+
+// Work-stealing engine: the push kernels run over 2-D tiles instead of rows, for worlds whose
+// animals are clustered. The animals a tile held in the previous generation (per species) are
+// its estimated cost; every thread takes a contiguous run of tiles with an equal share of the
+// estimated cost into its deque, and threads that run out steal tiles from the others. The deques
+// of a phase are filled during the copy-back of the previous one, so no barrier is added to the
+// push engine. The load imbalance, max/mean of the threads' busy time per phase, is reported.
+int STEAL_TILE = 0; // Tile side (-t), 0: about 64 tiles per thread
+
+typedef struct {
+    double start, busy; // Busy time of the current phase
+    long long stolen;
+} __attribute__((aligned(64))) StealStats;
+
+// Pushes thread t's run of tiles into its deque, in reverse so the owner pops them in order. A
+// tile costs its animals plus its rows (each row is scanned once); tile k goes to the thread whose
+// share of the total holds the middle of the tile's cost.
+static void steal_fill(Deque *q, const int *cost, int n_tiles, int tile_rows, int t, int n) {
+    long long total = 0, acc = 0;
+    for (int k = 0; k < n_tiles; k++) total += cost[k] + tile_rows;
+    int from = n_tiles, to = n_tiles;
+    for (int k = 0; k < n_tiles; k++) {
+        long long c = cost[k] + tile_rows;
+        int owner = (int)((acc + c / 2) * n / total);
+        acc += c;
+        if (owner == t && from == n_tiles) from = k;
+        if (owner > t) {
+            to = k;
+            break;
+        }
+    }
+    deque_clear(q);
+    for (int k = to - 1; k >= from; k--) deque_push(q, k);
+}
+
+void run_steal(int gen_from, int gen_to) {
+    int n_threads = omp_get_max_threads();
+    int side = STEAL_TILE;
+    if (side <= 0) {
+        // About 64 tiles per thread, at least 8x8 cells
+        side = 8;
+        while ((long long)(2 * side) * (2 * side) * 64 * n_threads <= (long long)R * C) side *= 2;
+    }
+    int tiles_r = (R + side - 1) / side, tiles_c = (C + side - 1) / side, n_tiles = tiles_r * tiles_c;
+    int *rabbit_cost = (int *)calloc(n_tiles, sizeof(int));
+    int *fox_cost = (int *)calloc(n_tiles, sizeof(int));
+    List *dirty = (List *)calloc(n_threads, sizeof(List)); // Cells written by each thread
+    Deque *q = (Deque *)aligned_alloc(64, n_threads * sizeof(Deque));
+    StealStats *st = (StealStats *)aligned_alloc(64, n_threads * sizeof(StealStats));
+    if (!rabbit_cost || !fox_cost || !dirty || !q || !st) {
+        fprintf(stderr, "Erro ao alocar memória\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(st, 0, n_threads * sizeof(StealStats));
+    for (int t = 0; t < n_threads; t++) deque_init(&q[t], n_tiles);
+    double sum_max = 0, sum_mean = 0; // Busy time per phase: slowest thread and average
+
+    push_setup();
+
+    #pragma omp parallel num_threads(n_threads)
+    {
+        int t = omp_get_thread_num(), n = omp_get_num_threads();
+        List *written = &dirty[t];
+
+        // Initial estimates: the animals of every tile
+        #pragma omp for schedule(static)
+        for (int tile = 0; tile < n_tiles; tile++) {
+            int r0 = tile / tiles_c * side, c0 = tile % tiles_c * side;
+            int r1 = r0 + side < R ? r0 + side : R, c1 = c0 + side < C ? c0 + side : C;
+            for (int i = r0; i < r1; i++) {
+                for (int j = c0; j < c1; j++) {
+                    rabbit_cost[tile] += grid1.type[i * C + j] == RABBIT;
+                    fox_cost[tile] += grid1.type[i * C + j] == FOX;
+                }
+            }
+        }
+        steal_fill(&q[t], rabbit_cost, n_tiles, side, t, n);
+        #pragma omp barrier
+
+        for (int gen = gen_from; gen < gen_to; gen++) {
+
+            // ================= PHASE 1: RABBITS =================
+            // Input: grid1, Output: grid2 (equal to grid1 on entry)
+
+            written->n = 0;
+            st[t].start = omp_get_wtime();
+            for (int tile; (tile = deque_next(q, t, n, &st[t].stolen)) >= 0;) {
+                int r0 = tile / tiles_c * side, c0 = tile % tiles_c * side;
+                int r1 = r0 + side < R ? r0 + side : R, c1 = c0 + side < C ? c0 + side : C;
+                int count = 0;
+                for (int i = r0; i < r1; i++) {
+                    const uint8_t *row = grid1.type + (size_t)i * C;
+                    if (!memchr(row + c0, RABBIT, c1 - c0)) continue;
+                    for (int j = c0; j < c1; j++) {
+                        if (row[j] != RABBIT) continue;
+                        int idx = i * C + j;
+                        count++;
+                        int dir = rabbit_move(cell_mask(grid1.type, i, j), gen, i, j);
+                        int new_proc_age = rabbit_age(grid1.proc_age[idx]);
+                        if (dir == STAY) {
+                            Cell stay = {RABBIT, new_proc_age, 0};
+                            set_rabbit_source(idx, stay);
+                            list_push(written, idx);
+                            continue;
+                        }
+                        int baby = new_proc_age > GEN_PROC_RABBITS;
+                        if (baby) new_proc_age = 0;
+                        int next_idx = (i + dr[dir]) * C + j + dc[dir];
+                        if (place_rabbit(next_idx, new_proc_age)) list_push(written, next_idx);
+                        // Leave baby at old position, or empty it
+                        Cell old = {baby ? RABBIT : EMPTY, 0, 0};
+                        set_rabbit_source(idx, old);
+                        list_push(written, idx);
+                    }
+                }
+                rabbit_cost[tile] = count;
+            }
+            st[t].busy = omp_get_wtime() - st[t].start;
+            #pragma omp barrier
+
+            // Copy the cells written in grid2 back into grid1, and deal the fox tiles
+            for (int k = 0; k < written->n; k++) {
+                int idx = written->idx[k];
+#ifdef LOCK_FREE
+                set_cell(grid2, idx, unpack_cell(cells2[idx]));
+                cells1[idx] = cells2[idx];
+#endif
+                set_cell(grid1, idx, get_cell(grid2, idx));
+            }
+            steal_fill(&q[t], fox_cost, n_tiles, side, t, n);
+            #pragma omp master
+            {
+                double max = 0, sum = 0;
+                for (int k = 0; k < n; k++) {
+                    max = st[k].busy > max ? st[k].busy : max;
+                    sum += st[k].busy;
+                }
+                sum_max += max;
+                sum_mean += sum / n;
+            }
+            #pragma omp barrier
+
+            // ================= PHASE 2: FOXES =================
+            // Input: grid2, Output: grid1 (equal to grid2 on entry)
+
+            written->n = 0;
+            st[t].start = omp_get_wtime();
+            for (int tile; (tile = deque_next(q, t, n, &st[t].stolen)) >= 0;) {
+                int r0 = tile / tiles_c * side, c0 = tile % tiles_c * side;
+                int r1 = r0 + side < R ? r0 + side : R, c1 = c0 + side < C ? c0 + side : C;
+                int count = 0;
+                for (int i = r0; i < r1; i++) {
+                    const uint8_t *row = grid2.type + (size_t)i * C;
+                    if (!memchr(row + c0, FOX, c1 - c0)) continue;
+                    for (int j = c0; j < c1; j++) {
+                        if (row[j] != FOX) continue;
+                        int idx = i * C + j;
+                        count++;
+                        list_push(written, idx);
+                        int ate;
+                        int dir = fox_move(cell_mask(grid2.type, i, j), gen, i, j, grid2.food_age[idx], &ate);
+                        if (dir == DIE) {
+                            Cell empty = {EMPTY, 0, 0};
+                            set_fox_source(idx, empty);
+                            continue;
+                        }
+                        int new_proc_age = grid2.proc_age[idx] + 1;
+                        int new_food_age = ate ? 0 : grid2.food_age[idx] + 1;
+                        if (dir == STAY) {
+                            Cell stay = {FOX, new_proc_age, new_food_age};
+                            set_fox_source(idx, stay);
+                            continue;
+                        }
+                        int baby = new_proc_age > GEN_PROC_FOXES;
+                        if (baby) new_proc_age = 0;
+                        int next_idx = (i + dr[dir]) * C + j + dc[dir];
+                        if (place_fox(next_idx, new_proc_age, new_food_age)) list_push(written, next_idx);
+                        // Leave baby at old position, or empty it
+                        Cell old = {baby ? FOX : EMPTY, 0, 0};
+                        set_fox_source(idx, old);
+                    }
+                }
+                fox_cost[tile] = count;
+            }
+            st[t].busy = omp_get_wtime() - st[t].start;
+            #pragma omp barrier
+
+            // Copy the cells written in grid1 back into grid2, and deal the rabbit tiles
+            for (int k = 0; k < written->n; k++) {
+                int idx = written->idx[k];
+#ifdef LOCK_FREE
+                set_cell(grid1, idx, unpack_cell(cells1[idx]));
+                cells2[idx] = cells1[idx];
+#endif
+                set_cell(grid2, idx, get_cell(grid1, idx));
+            }
+            steal_fill(&q[t], rabbit_cost, n_tiles, side, t, n);
+            #pragma omp master
+            {
+                double max = 0, sum = 0;
+                for (int k = 0; k < n; k++) {
+                    max = st[k].busy > max ? st[k].busy : max;
+                    sum += st[k].busy;
+                }
+                sum_max += max;
+                sum_mean += sum / n;
+            }
+            #pragma omp barrier
+        }
+    }
+
+    long long stolen = 0;
+    for (int t = 0; t < n_threads; t++) {
+        stolen += st[t].stolen;
+        deque_free(&q[t]);
+        free(dirty[t].idx);
+    }
+    fprintf(stderr, "Steal: %d tiles of %dx%d, %lld stolen, load imbalance %.3f (max/mean busy time per phase)\n",
+            n_tiles, side, side, stolen, sum_mean > 0 ? sum_max / sum_mean : 1.0);
+    free(rabbit_cost);
+    free(fox_cost);
+    free(dirty);
+    free(q);
+    free(st);
+}
+
+// Dataflow engine: the gather kernels run as OpenMP tasks over bands of rows, without barriers.
+// The rabbit task of a band computes the moves of its rows plus one row on each side (into a
+// buffer of the thread) and gathers its rows of grid2, so it reads grid1 two rows beyond the band;
+// with bands of at least 2 rows it depends only on the fox tasks of the previous generation for
+// the band and its two neighbours, and the fox task likewise on the rabbit tasks. depend clauses on
+// one sentinel per band and grid express that, so phases and generations overlap in a wavefront
+// instead of the whole team waiting for the slowest band. Task times are recorded to estimate the
+// wall time of the same tasks with a barrier after every phase (bands dealt statically).
+int FLOW_ROWS = 0; // Band height (-t), 0: about 4 bands per thread
+
+typedef struct {
+    uint8_t *mask;   // Neighbour masks of a row
+    signed char *mv; // Moves of the rows of the running task's band plus one row on each side
+    double busy;
+} __attribute__((aligned(64))) FlowThread;
+
+// Task durations of the generations in flight
+typedef struct {
+    int nb, slots, n_threads;
+    double *dur; // [slot][phase][band]
+    int *done;   // [slot][phase]
+    double barrier_wall, barrier_idle;
+} FlowTimes;
+
+static void flow_record(FlowTimes *ft, int gen, int phase, int b, double dur) {
+    int slot = (gen % ft->slots) * 2 + phase, done;
+    double *d = ft->dur + (size_t)slot * ft->nb;
+    d[b] = dur;
+    // seq_cst: the last band of the phase reads the durations the others stored before counting
+    #pragma omp atomic capture seq_cst
+    done = ++ft->done[slot];
+    if (done < ft->nb) return;
+    // Last band of the phase: cost of the phase with a barrier after it
+    double max = 0, total = 0;
+    for (int t = 0; t < ft->n_threads; t++) {
+        double sum = 0;
+        for (int k = t * ft->nb / ft->n_threads; k < (t + 1) * ft->nb / ft->n_threads; k++) sum += d[k];
+        max = sum > max ? sum : max;
+        total += sum;
+    }
+    ft->done[slot] = 0;
+    #pragma omp atomic
+    ft->barrier_wall += max;
+    #pragma omp atomic
+    ft->barrier_idle += ft->n_threads * max - total;
+}
+
+static void flow_rabbits(int lo, int hi, int gen, FlowThread *ft) {
+    int from = lo > 0 ? lo - 1 : 0, to = hi < R ? hi + 1 : R;
+    signed char *mv = ft->mv + C - (size_t)lo * C; // mv[i * C + j] for rows lo - 1 .. hi
+    for (int i = from; i < to; i++) {
+        if (!memchr(grid1.type + (size_t)i * C, RABBIT, C)) continue;
+        row_masks(grid1.type, i, ft->mask);
+        for (int j = 0; j < C; j++) {
+            int idx = i * C + j;
+            if (grid1.type[idx] == RABBIT) mv[idx] = (signed char)rabbit_move(ft->mask[j], gen, i, j);
+        }
+    }
+    for (int i = lo; i < hi; i++) gather_rabbit_row(mv, i);
+}
+
+static void flow_foxes(int lo, int hi, int gen, FlowThread *ft) {
+    int from = lo > 0 ? lo - 1 : 0, to = hi < R ? hi + 1 : R;
+    signed char *mv = ft->mv + C - (size_t)lo * C;
+    for (int i = from; i < to; i++) {
+        if (!memchr(grid2.type + (size_t)i * C, FOX, C)) continue;
+        row_masks(grid2.type, i, ft->mask);
         for (int j = 0; j < C; j++) {
             int idx = i * C + j;
-            if (grid1[idx].type == ROCK) printf("ROCK %d %d\n", i, j);
-            else if (grid1[idx].type == RABBIT) printf("RABBIT %d %d\n", i, j);
-            else if (grid1[idx].type == FOX) printf("FOX %d %d\n", i, j);
+            if (grid2.type[idx] == FOX) {
+                int ate;
+                mv[idx] = (signed char)fox_move(ft->mask[j], gen, i, j, grid2.food_age[idx], &ate);
+            }
+        }
+    }
+    for (int i = lo; i < hi; i++) gather_fox_row(mv, i);
+}
+
+void run_flow(int gen_from, int gen_to) {
+    int n_threads = omp_get_max_threads();
+    int rows = FLOW_ROWS > 0 ? FLOW_ROWS : R / (4 * n_threads);
+    if (rows < 2) rows = 2;
+    if (rows > R) rows = R;
+    int nb = (R + rows - 1) / rows;
+    // Sentinels of the bands of grid1 and grid2, one set per generation in flight (generations
+    // `window` apart share a set). The wavefront spans at most about nb / 2 generations. The first
+    // rabbit tasks depend on generation gen_from - 1, which may be -1: its set is the last one, and
+    // no task has written it yet.
+    int window = nb + 2;
+    char *dep = (char *)malloc((size_t)window * 2 * nb);
+#define DEP1(g, b) dep[((size_t)(((g) + window) % window) * 2) * nb + (b)]
+#define DEP2(g, b) dep[((size_t)(((g) + window) % window) * 2 + 1) * nb + (b)]
+    FlowThread *th = (FlowThread *)aligned_alloc(64, n_threads * sizeof(FlowThread));
+    FlowTimes times = {nb, window, n_threads, NULL, NULL, 0, 0};
+    times.dur = (double *)calloc((size_t)times.slots * 2 * nb, sizeof(double));
+    times.done = (int *)calloc((size_t)times.slots * 2, sizeof(int));
+    if (!dep || !th || !times.dur || !times.done) {
+        fprintf(stderr, "Erro ao alocar memória\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int t = 0; t < n_threads; t++) {
+        th[t].mask = (uint8_t *)malloc(C);
+        th[t].mv = (signed char *)malloc((size_t)(rows + 2) * C);
+        th[t].busy = 0;
+        if (!th[t].mask || !th[t].mv) {
+            fprintf(stderr, "Erro ao alocar memória\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double start = omp_get_wtime();
+    #pragma omp parallel
+    #pragma omp single
+    {
+        for (int gen = gen_from; gen < gen_to; gen++) {
+            // At most `window` generations in flight: wait for the fox tasks of gen - window
+            if (gen - gen_from >= window) {
+                for (int b = 0; b < nb; b++) {
+                    #pragma omp taskwait depend(in: DEP1(gen, b))
+                }
+            }
+            for (int b = 0; b < nb; b++) {
+                int bm = b > 0 ? b - 1 : b, bp = b < nb - 1 ? b + 1 : b;
+                #pragma omp task firstprivate(gen, b) depend(in: DEP1(gen - 1, bm), DEP1(gen - 1, b), DEP1(gen - 1, bp)) \
+                                 depend(out: DEP2(gen, b))
+                {
+                    FlowThread *ft = &th[omp_get_thread_num()];
+                    double t0 = omp_get_wtime();
+                    flow_rabbits(b * rows, (b + 1) * rows < R ? (b + 1) * rows : R, gen, ft);
+                    double dt = omp_get_wtime() - t0;
+                    ft->busy += dt;
+                    flow_record(&times, gen, 0, b, dt);
+                }
+            }
+            for (int b = 0; b < nb; b++) {
+                int bm = b > 0 ? b - 1 : b, bp = b < nb - 1 ? b + 1 : b;
+                #pragma omp task firstprivate(gen, b) depend(in: DEP2(gen, bm), DEP2(gen, b), DEP2(gen, bp)) \
+                                 depend(out: DEP1(gen, b))
+                {
+                    FlowThread *ft = &th[omp_get_thread_num()];
+                    double t0 = omp_get_wtime();
+                    flow_foxes(b * rows, (b + 1) * rows < R ? (b + 1) * rows : R, gen, ft);
+                    double dt = omp_get_wtime() - t0;
+                    ft->busy += dt;
+                    flow_record(&times, gen, 1, b, dt);
+                }
+            }
+        }
+    }
+#undef DEP1
+#undef DEP2
+    double wall = omp_get_wtime() - start, busy = 0;
+    for (int t = 0; t < n_threads; t++) {
+        busy += th[t].busy;
+        free(th[t].mask);
+        free(th[t].mv);
+    }
+    // idle also counts the thread creating the tasks; the barrier estimate assumes the same task
+    // durations with the bands dealt statically, so the saving is only an estimate
+    double idle = n_threads * wall - busy, saved = times.barrier_wall - wall;
+    fprintf(stderr, "Flow: %d bands of %d rows, busy %.3f s, idle or creating tasks %.3f s; with a barrier per phase "
+                    "the same tasks would take about %.3f s with %.3f s of barrier wait (estimated saving %.3f s)\n",
+            nb, rows, busy, idle, times.barrier_wall, times.barrier_idle, saved > 0 ? saved : 0.0);
+    free(dep);
+    free(th);
+    free(times.dur);
+    free(times.done);
+}
+
+// Checkpoints: between generations grid1 holds the whole state (every engine rebuilds grid2 from
+// it), so a checkpoint copies grid1 into a private snapshot and a background thread writes the
+// snapshot while the simulation goes on. At most one write is in flight; the next checkpoint waits
+// for it. main() runs the engine in segments that end where a checkpoint may be due: every
+// CKPT_EVERY generations and/or roughly every CKPT_SECONDS seconds.
+const char *CKPT_PATH = NULL;
+int CKPT_EVERY = 0;
+double CKPT_SECONDS = 0;
+
+typedef struct {
+    Grid grid;
+    WorldHeader h;
+    pthread_t writer;
+    int pending;
+    int failed;
+} Checkpoint;
+
+Checkpoint ckpt;
+
+void *checkpoint_writer(void *arg) {
+    Checkpoint *c = (Checkpoint *)arg;
+    if (!world_write_checkpoint(CKPT_PATH, &c->h, c->grid.type, c->grid.proc_age, c->grid.food_age)) c->failed = 1;
+    return NULL;
+}
+
+void checkpoint_wait() {
+    if (ckpt.pending) pthread_join(ckpt.writer, NULL);
+    ckpt.pending = 0;
+}
+
+void checkpoint_save(int gen) {
+    checkpoint_wait();
+    if (!ckpt.grid.type) alloc_grid(&ckpt.grid, (size_t)R * C);
+    int count = 0;
+    #pragma omp parallel for schedule(static) reduction(+:count)
+    for (int i = 0; i < R; i++) {
+        size_t from = (size_t)i * C;
+        memcpy(ckpt.grid.type + from, grid1.type + from, C * sizeof(uint8_t));
+        memcpy(ckpt.grid.proc_age + from, grid1.proc_age + from, C * sizeof(Age));
+        memcpy(ckpt.grid.food_age + from, grid1.food_age + from, C * sizeof(Age));
+        for (int j = 0; j < C; j++) count += grid1.type[from + j] != EMPTY;
+    }
+    WorldHeader h = {CHECKPOINT_MAGIC, GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES, N_GEN, R, C, count,
+                     gen, (int32_t)sizeof(Age), {0}};
+    ckpt.h = h;
+    if (pthread_create(&ckpt.writer, NULL, checkpoint_writer, &ckpt) == 0) ckpt.pending = 1;
+    else checkpoint_writer(&ckpt);
+}
+
+// Runs generations gen_from..N_GEN, stopping at the generations where a checkpoint is due
+void run_checkpointed(void (*engine)(int, int), int gen_from) {
+    if (!CKPT_PATH || (CKPT_EVERY <= 0 && CKPT_SECONDS <= 0)) {
+        engine(gen_from, N_GEN);
+        return;
+    }
+    int gen = gen_from;
+    int segment = 1; // Generations between time checks, adapted to the measured speed
+    double last = omp_get_wtime();
+    while (gen < N_GEN) {
+        int next = N_GEN;
+        if (CKPT_EVERY > 0 && (gen / CKPT_EVERY + 1) * CKPT_EVERY < next) next = (gen / CKPT_EVERY + 1) * CKPT_EVERY;
+        if (CKPT_SECONDS > 0 && gen + segment < next) next = gen + segment;
+        double t0 = omp_get_wtime();
+        engine(gen, next);
+        double now = omp_get_wtime();
+        if (CKPT_SECONDS > 0) {
+            // Aim for about four time checks per interval
+            double per_gen = (now - t0) / (next - gen);
+            double target = CKPT_SECONDS / 4 / (per_gen > 1e-9 ? per_gen : 1e-9);
+            segment = target < 1 ? 1 : target > 1 << 20 ? 1 << 20 : (int)target;
+        }
+        gen = next;
+        if (gen < N_GEN && ((CKPT_EVERY > 0 && gen % CKPT_EVERY == 0) || (CKPT_SECONDS > 0 && now - last >= CKPT_SECONDS))) {
+            checkpoint_save(gen);
+            last = now;
+        }
+    }
+    checkpoint_wait();
+    if (ckpt.grid.type) free_grid(&ckpt.grid);
+}
+
+// Batch mode (--batch=manifest): many small independent worlds, one per thread at a time instead
+// of all threads on one world. Every manifest line is "input output [gen_proc_rabbits
+// gen_proc_foxes gen_food_foxes [n_gen]]" (blank lines and # comments are skipped); the optional
+// values override the input's header, so a sweep can reuse one layout. Scenarios are dealt to
+// per-thread deques by estimated cost (R * C * N_GEN) and idle threads steal from the others.
+// A scenario runs the tile engine's kernel over the whole world plus a ROCK ring, in buffers the
+// thread keeps from one scenario to the next, and its final world goes to its own output file.
+typedef struct {
+    char *input;
+    char *output;
+    int rules[3]; // GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES overrides (-1: from the input)
+    int n_gen;    // N_GEN override (-1: from the input)
+    double cost;
+} Scenario;
+
+// Buffers of one batch thread, grown to the largest world it has run
+typedef struct {
+    Grid a, b;   // (R + 2) x (C + 2), world plus ROCK ring
+    Grid plane;  // R x C, as loaded and written
+    size_t ring_cap, plane_cap;
+} BatchBuffers;
+
+void reserve_grid(Grid *g, size_t *cap, size_t n_cells) {
+    if (n_cells <= *cap) return;
+    if (*cap) free_grid(g);
+    alloc_grid(g, n_cells);
+    *cap = n_cells;
+}
+
+// R * C * N_GEN of a scenario from the header of its input (0 when it cannot be read; the
+// scenario then fails when it runs)
+double scenario_cost(const Scenario *sc) {
+    WorldHeader h;
+    char line[sizeof(h) + 1];
+    int fd = open(sc->input, O_RDONLY);
+    if (fd < 0) return 0;
+    ssize_t got = read(fd, line, sizeof(h));
+    close(fd);
+    if (got <= 0) return 0;
+    line[got] = '\0';
+    if (got == sizeof(h) && (memcmp(line, WORLD_MAGIC, 8) == 0 || memcmp(line, CHECKPOINT_MAGIC, 8) == 0))
+        memcpy(&h, line, sizeof(h));
+    else if (sscanf(line, "%d %d %d %d %d %d", &h.gen_proc_rabbits, &h.gen_proc_foxes, &h.gen_food_foxes,
+                    &h.n_gen, &h.r, &h.c) != 6)
+        return 0;
+    return (double)h.r * h.c * (sc->n_gen >= 0 ? sc->n_gen : h.n_gen);
+}
+
+// Runs one scenario with the thread's buffers; returns 0 on error
+int run_scenario(const Scenario *sc, BatchBuffers *buf) {
+    World world;
+    int fd = open(sc->input, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Erro ao abrir %s\n", sc->input);
+        return 0;
+    }
+    int ok = world_open(&world, fd);
+    close(fd);
+    if (!ok) return 0;
+    if (!world_not_checkpoint(&world, sc->input)) {
+        world_close(&world);
+        return 0;
+    }
+    int rows_in = world.h.r, cols_in = world.h.c, rows = rows_in + 2, cols = cols_in + 2;
+    Rules rules = {world.h.gen_proc_rabbits, world.h.gen_proc_foxes, world.h.gen_food_foxes};
+    if (sc->rules[0] >= 0) rules = (Rules){sc->rules[0], sc->rules[1], sc->rules[2]};
+    int n_gen = sc->n_gen >= 0 ? sc->n_gen : world.h.n_gen;
+    if ((long long)rows * cols > 0x7FFFFFFF || rules.proc_rabbits + 1 > AGE_MAX ||
+        rules.proc_foxes + rules.food_foxes > AGE_MAX) {
+        fprintf(stderr, "%s: grid or GEN_PROC_* / GEN_FOOD_FOXES exceed the limits of this build\n", sc->input);
+        world_close(&world);
+        return 0;
+    }
+
+    size_t cells = (size_t)rows_in * cols_in;
+    reserve_grid(&buf->plane, &buf->plane_cap, cells);
+    memset(buf->plane.type, 0, cells);
+    memset(buf->plane.proc_age, 0, cells * sizeof(Age));
+    memset(buf->plane.food_age, 0, cells * sizeof(Age));
+    ok = world_load(&world, buf->plane.type);
+    world_close(&world);
+    if (!ok) return 0;
+
+    size_t ring_cap = buf->ring_cap;
+    reserve_grid(&buf->a, &buf->ring_cap, (size_t)rows * cols);
+    reserve_grid(&buf->b, &ring_cap, (size_t)rows * cols);
+    Grid a = buf->a, p = buf->plane;
+    memset(a.type, ROCK, (size_t)rows * cols);
+    for (int i = 0; i < rows_in; i++) {
+        size_t to = (size_t)(i + 1) * cols + 1, from = (size_t)i * cols_in;
+        memcpy(a.type + to, p.type + from, cols_in * sizeof(uint8_t));
+        memcpy(a.proc_age + to, p.proc_age + from, cols_in * sizeof(Age));
+        memcpy(a.food_age + to, p.food_age + from, cols_in * sizeof(Age));
+    }
+    for (int gen = 0; gen < n_gen; gen++) local_generation(a, buf->b, rows, cols, -1, -1, gen, rules);
+    for (int i = 0; i < rows_in; i++) memcpy(p.type + (size_t)i * cols_in, a.type + (size_t)(i + 1) * cols + 1, cols_in);
+
+    WorldHeader out = {WORLD_MAGIC, rules.proc_rabbits, rules.proc_foxes, rules.food_foxes, 0, rows_in, cols_in, 0, 0, 0, {0}};
+    fd = open(sc->output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Erro ao abrir %s\n", sc->output);
+        return 0;
+    }
+    ok = world_write_text(fd, &out, p.type);
+    return close(fd) == 0 && ok;
+}
+
+// Reads the manifest; returns the number of scenarios, -1 on error
+int read_manifest(const char *path, Scenario **out) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Erro ao abrir %s\n", path);
+        return -1;
+    }
+    Scenario *sc = NULL;
+    int n = 0, cap = 0, line_no = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    while (getline(&line, &line_cap, f) > 0) {
+        line_no++;
+        char *p = line + strspn(line, " \t\r\n");
+        if (*p == '\0' || *p == '#') continue;
+        Scenario s = {NULL, NULL, {-1, -1, -1}, -1, 0};
+        // 0, 3 or 4 non-negative numbers after the two paths, then at most a comment
+        int used = 0, value[4], n_values = 0, bad = sscanf(p, "%ms %ms%n", &s.input, &s.output, &used) != 2;
+        for (p += bad ? 0 : used; !bad && *(p += strspn(p, " \t\r\n")) != '\0' && *p != '#'; n_values++) {
+            char *end;
+            long v = strtol(p, &end, 10);
+            bad = end == p || v < 0 || v > 0x7FFFFFFF || n_values == 4 || !strchr(" \t\r\n#", *end);
+            if (!bad) value[n_values] = (int)v;
+            p = end;
+        }
+        if (!bad && n_values >= 3) memcpy(s.rules, value, sizeof(s.rules));
+        if (!bad && n_values == 4) s.n_gen = value[3];
+        if (bad || (n_values != 0 && n_values != 3 && n_values != 4)) {
+            fprintf(stderr, "Erro na leitura do manifesto (%s, linha %d: expected \"input output "
+                            "[gen_proc_rabbits gen_proc_foxes gen_food_foxes [n_gen]]\")\n", path, line_no);
+            free(s.input);
+            free(s.output);
+            n = -1;
+            break;
         }
+        if (n == cap) {
+            cap = cap ? 2 * cap : 256;
+            sc = (Scenario *)realloc(sc, (size_t)cap * sizeof(Scenario));
+            if (!sc) {
+                fprintf(stderr, "Erro ao alocar memória\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        sc[n++] = s;
+    }
+    free(line);
+    fclose(f);
+    *out = sc;
+    return n;
+}
+
+static int by_cost(const void *x, const void *y) {
+    double a = ((const Scenario *)x)->cost, b = ((const Scenario *)y)->cost;
+    return (a > b) - (a < b);
+}
+
+int run_batch(const char *manifest) {
+    Scenario *sc;
+    int n_sc = read_manifest(manifest, &sc);
+    if (n_sc < 0) return 1;
+    for (int k = 0; k < n_sc; k++) sc[k].cost = scenario_cost(&sc[k]);
+    // Ascending cost, dealt round-robin: the owners pop their largest scenarios first and the
+    // thieves take the small ones at the top, which evens out the tail of the batch
+    qsort(sc, n_sc, sizeof(Scenario), by_cost);
+    int n_threads = omp_get_max_threads();
+    Deque *q = (Deque *)aligned_alloc(64, n_threads * sizeof(Deque));
+    int *ran = (int *)calloc(n_threads, sizeof(int));
+    long long *stolen = (long long *)calloc(n_threads, sizeof(long long));
+    if (!q || !ran || !stolen) {
+        fprintf(stderr, "Erro ao alocar memória\n");
+        return 1;
+    }
+    for (int t = 0; t < n_threads; t++) deque_init(&q[t], n_sc / n_threads + 1);
+    for (int k = 0; k < n_sc; k++) deque_push(&q[k % n_threads], k);
+
+    int failed = 0;
+    double start_time = omp_get_wtime();
+    #pragma omp parallel reduction(+:failed)
+    {
+        int t = omp_get_thread_num(), n = omp_get_num_threads();
+        omp_set_num_threads(1); // Loading and writing inside a scenario stay on this thread
+        BatchBuffers buf;
+        memset(&buf, 0, sizeof(buf));
+        for (int k; (k = deque_next(q, t, n, &stolen[t])) >= 0; ran[t]++) failed += !run_scenario(&sc[k], &buf);
+        if (buf.ring_cap) {
+            free_grid(&buf.a);
+            free_grid(&buf.b);
+        }
+        if (buf.plane_cap) free_grid(&buf.plane);
+    }
+    double elapsed = omp_get_wtime() - start_time;
+
+    fprintf(stderr, "Batch: %d scenarios (%d failed) on %d threads, %.1f scenarios/s\nScenarios per thread (stolen):",
+            n_sc, failed, n_threads, elapsed > 0 ? n_sc / elapsed : 0);
+    for (int t = 0; t < n_threads; t++) fprintf(stderr, " %d (%lld)", ran[t], stolen[t]);
+    fprintf(stderr, "\nExecution Time (batch): %f milliseconds\n", elapsed * 1000.0);
+    for (int t = 0; t < n_threads; t++) deque_free(&q[t]);
+    for (int k = 0; k < n_sc; k++) {
+        free(sc[k].input);
+        free(sc[k].output);
+    }
+    free(sc);
+    free(q);
+    free(ran);
+    free(stolen);
+    return failed ? 1 : 0;
+}
+
+// Engine selection. Every engine advances grid1 from generation gen_from to gen_to; -e picks one
+// by name, and -e auto (the default) picks the engine and thread count with the lowest estimated
+// time from a calibration table. Each row of the table models a run as
+//   start_us + N_GEN * (sync_us + R * C * cell_ns + N * object_ns)
+// i.e. the start-up of the run (thread team, lock table), the barriers of a generation, the scan
+// of the grid and the work per object of the input. The table is read from $ECOSYSTEM_CALIBRATION
+// (default ecosystem.calibration), written by --calibrate; without it a built-in estimate is used.
+typedef struct {
+    const char *name;
+    void (*run)(int, int);
+} Engine;
+
+const Engine engines[] = {{"seq", run_seq}, {"push", run_push}, {"gather", run_gather}, {"band", run_band},
+                          {"sparse", run_sparse}, {"tile", run_tile}, {"steal", run_steal}, {"flow", run_flow}};
+#define N_ENGINES (int)(sizeof(engines) / sizeof(engines[0]))
+#define MAX_COST_ROWS 64
+
+const Engine *find_engine(const char *name) {
+    for (int e = 0; e < N_ENGINES; e++)
+        if (strcmp(engines[e].name, name) == 0) return &engines[e];
+    return NULL;
+}
+
+typedef struct {
+    const Engine *engine;
+    int threads;
+    double start_us, sync_us, cell_ns, object_ns;
+} CostRow;
+
+CostRow cost_rows[MAX_COST_ROWS];
+int n_cost_rows = 0;
+
+double estimate_ms(const CostRow *row, double cells, double objects, int n_gen) {
+    return (row->start_us + n_gen * (row->sync_us + (cells * row->cell_ns + objects * row->object_ns) * 1e-3)) * 1e-3;
+}
+
+void add_cost_row(const Engine *engine, int threads, double start_us, double sync_us, double cell_ns, double object_ns) {
+    if (n_cost_rows == MAX_COST_ROWS) return;
+    CostRow row = {engine, threads, start_us, sync_us, cell_ns, object_ns};
+    cost_rows[n_cost_rows++] = row;
+}
+
+// 1, 2, 4... thread counts up to max_threads, which is always included
+static inline int next_threads(int p, int max_threads) {
+    return p * 2 < max_threads || p == max_threads ? p * 2 : max_threads;
+}
+
+// Built-in table: the sequential engine, and the push engine on powers of two threads (plus
+// max_threads) with the lock table, the barriers and the imperfect scaling of a shared grid
+void default_costs(int max_threads) {
+    add_cost_row(find_engine("seq"), 1, 0, 0.1, 0.1, 10);
+    for (int p = 1; p <= max_threads; p = next_threads(p, max_threads)) {
+        int log_p = 0;
+        while (2 << log_p <= p) log_p++;
+        add_cost_row(find_engine("push"), p, 400 + 30 * p, 1 + 4 * (1 + log_p), 0.15 / p * (1 + 0.1 * log_p),
+                     25 / p * (1 + 0.2 * log_p));
+    }
+}
+
+// Reads the table written by --calibrate: "engine threads start_us sync_us cell_ns object_ns"
+int load_costs(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char line[256], name[16];
+    int threads, ok = 1;
+    double v[4];
+    n_cost_rows = 0;
+    while (ok && fgets(line, sizeof(line), f)) {
+        if (line[strspn(line, " \t")] == '#' || line[strspn(line, " \t\r\n")] == '\0') continue;
+        ok = sscanf(line, "%15s %d %lf %lf %lf %lf", name, &threads, &v[0], &v[1], &v[2], &v[3]) == 6 &&
+             find_engine(name) && threads > 0;
+        if (ok) add_cost_row(find_engine(name), threads, v[0], v[1], v[2], v[3]);
+    }
+    fclose(f);
+    if (!ok || n_cost_rows == 0) {
+        fprintf(stderr, "Erro na leitura de %s\n", path);
+        n_cost_rows = 0;
+    }
+    return n_cost_rows > 0;
+}
+
+// Cheapest row with at most max_threads threads (only the push engine gathers --series)
+const CostRow *select_engine(int max_threads, int push_only, int n_gen) {
+    const CostRow *best = NULL;
+    double best_ms = 0;
+    for (int k = 0; k < n_cost_rows; k++) {
+        const CostRow *row = &cost_rows[k];
+        if (row->threads > max_threads || (push_only && row->engine->run != run_push)) continue;
+        double ms = estimate_ms(row, (double)R * C, N, n_gen);
+        if (!best || ms < best_ms) {
+            best = row;
+            best_ms = ms;
+        }
+    }
+    return best;
+}
+
+// Synthetic calibration world: rocks plus animals at the given density, 4 rabbits to 1 fox
+int calibration_world(int rows, int cols, double animals, Grid start) {
+    R = rows;
+    C = cols;
+    int count = 0;
+    for (int k = 0; k < R * C; k++) {
+        double u = (mix64(k + 1) >> 11) * (1.0 / 9007199254740992.0);
+        start.type[k] = u < 0.05 ? ROCK : u < 0.05 + 0.8 * animals ? RABBIT : u < 0.05 + animals ? FOX : EMPTY;
+        start.proc_age[k] = start.food_age[k] = 0;
+        count += start.type[k] != EMPTY;
+    }
+    return count;
+}
+
+// Best of three timed runs of gens generations from start (seconds)
+double calibration_time(const Engine *engine, Grid start, int gens) {
+    double best = 0;
+    for (int rep = 0; rep < 3; rep++) {
+        memcpy(grid1.type, start.type, (size_t)R * C * sizeof(uint8_t));
+        memcpy(grid1.proc_age, start.proc_age, (size_t)R * C * sizeof(Age));
+        memcpy(grid1.food_age, start.food_age, (size_t)R * C * sizeof(Age));
+        double t0 = omp_get_wtime();
+        engine->run(0, gens);
+        double t = omp_get_wtime() - t0;
+        if (rep == 0 || t < best) best = t;
+    }
+    return best;
+}
+
+// --calibrate: times the seq engine and the push engine on 1, 2, 4... max_threads threads over a
+// tiny world, a large sparse world and a large dense world, solves each row's model from the
+// three times per generation (the start-up is timed apart, as an empty run on a fresh grid) and
+// writes the table to path
+int calibrate(const char *path, int max_threads) {
+    enum { TINY, SPARSE, DENSE, WORLDS };
+    const int side[WORLDS] = {16, 384, 384}, gens[WORLDS] = {2000, 20, 20};
+    const double density[WORLDS] = {0.15, 0.01, 0.3};
+    GEN_PROC_RABBITS = 3; GEN_PROC_FOXES = 20; GEN_FOOD_FOXES = 10;
+    Grid start;
+    alloc_grid(&start, (size_t)side[SPARSE] * side[SPARSE]);
+    select_row_masks();
+    n_cost_rows = 0;
+    for (int p = 1; p <= max_threads; p = next_threads(p, max_threads)) {
+        for (int e = 0; e < 2; e++) {
+            if (e == 0 && p > 1) continue;
+            const Engine *engine = find_engine(e == 0 ? "seq" : "push");
+            omp_set_num_threads(p);
+            double per_gen[WORLDS], cells[WORLDS], objects[WORLDS], start_us = 0;
+            for (int w = 0; w < WORLDS; w++) {
+                objects[w] = calibration_world(side[w], side[w], density[w], start);
+                cells[w] = (double)R * C;
+                init_grids();
+                if (w == TINY) {
+                    memset(grid1.type, EMPTY, (size_t)R * C);
+                    double t0 = omp_get_wtime();
+                    engine->run(0, 0);
+                    start_us = (omp_get_wtime() - t0) * 1e6;
+                }
+                per_gen[w] = calibration_time(engine, start, gens[w]) * 1e6 / gens[w];
+                // The population changes during the run: use the mean of the first and last count
+                int last = 0;
+                for (int k = 0; k < R * C; k++) last += grid1.type[k] != EMPTY;
+                objects[w] = (objects[w] + last) / 2;
+                destroy_grids();
+            }
+            // Same grid size for SPARSE and DENSE, so their difference is the work of the objects
+            double object_us = (per_gen[DENSE] - per_gen[SPARSE]) / (objects[DENSE] - objects[SPARSE]);
+            if (object_us < 0) object_us = 0;
+            double cell_us = (per_gen[SPARSE] - objects[SPARSE] * object_us - per_gen[TINY] + objects[TINY] * object_us) /
+                             (cells[SPARSE] - cells[TINY]);
+            if (cell_us < 0) cell_us = 0;
+            double sync_us = per_gen[TINY] - cells[TINY] * cell_us - objects[TINY] * object_us;
+            if (sync_us < 0) sync_us = 0;
+            add_cost_row(engine, p, start_us, sync_us, cell_us * 1e3, object_us * 1e3);
+            fprintf(stderr, "%s, %d thread(s): %.1f us start, %.2f us/gen + %.3f ns/cell + %.2f ns/object\n",
+                    engine->name, p, start_us, sync_us, cell_us * 1e3, object_us * 1e3);
+        }
+    }
+    free_grid(&start);
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Erro ao abrir %s\n", path);
+        return 1;
+    }
+    fprintf(f, "# engine threads start_us sync_us cell_ns object_ns (ecosystem --calibrate)\n");
+    for (int k = 0; k < n_cost_rows; k++)
+        fprintf(f, "%s %d %.3f %.4f %.5f %.4f\n", cost_rows[k].engine->name, cost_rows[k].threads,
+                cost_rows[k].start_us, cost_rows[k].sync_us, cost_rows[k].cell_ns, cost_rows[k].object_ns);
+    int failed = fclose(f) != 0;
+    fprintf(stderr, "Calibration written to %s\n", path);
+    return failed;
+}
+
+// Thread placement (--affinity): the allowed CPUs are grouped by NUMA node (sysfs cpulists, one
+// node when they are missing); compact fills a node before moving to the next, spread deals the
+// threads round-robin over the nodes. Each thread of the pool pins itself once; the engines run
+// their parallel regions with the same team, so the placement holds for the whole run.
+int read_cpulist(const char *path, int *node_of, int node) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int a, b, found = 0;
+    char sep = ',';
+    while (sep == ',' && fscanf(f, "%d", &a) == 1) {
+        b = a;
+        if (fscanf(f, "%c", &sep) == 1 && sep == '-' && (fscanf(f, "%d", &b) != 1 || fscanf(f, "%c", &sep) != 1)) sep = '\n';
+        for (int c = a; c <= b && c < CPU_SETSIZE; c++) node_of[c] = node;
+        found = 1;
+    }
+    fclose(f);
+    return found;
+}
+
+int set_affinity(const char *policy) {
+    int spread = strcmp(policy, "spread") == 0;
+    if (!spread && strcmp(policy, "compact") != 0) return 0;
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return 0;
+    static int node_of[CPU_SETSIZE], order[CPU_SETSIZE];
+    int n_nodes = 0, n = 0;
+    for (int c = 0; c < CPU_SETSIZE; c++) node_of[c] = 0;
+    for (int node = 0; node < 256; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        if (read_cpulist(path, node_of, n_nodes)) n_nodes++;
+    }
+    if (n_nodes == 0) n_nodes = 1;
+    if (spread) {
+        // The k-th CPU of every node, for k = 0, 1, ...
+        for (int k = 0; n < CPU_COUNT(&allowed); k++)
+            for (int node = 0; node < n_nodes; node++)
+                for (int c = 0, seen = 0; c < CPU_SETSIZE; c++)
+                    if (CPU_ISSET(c, &allowed) && node_of[c] == node && seen++ == k) order[n++] = c;
+    } else {
+        for (int node = 0; node < n_nodes; node++)
+            for (int c = 0; c < CPU_SETSIZE; c++)
+                if (CPU_ISSET(c, &allowed) && node_of[c] == node) order[n++] = c;
+    }
+    #pragma omp parallel
+    {
+        cpu_set_t cpu;
+        CPU_ZERO(&cpu);
+        CPU_SET(order[omp_get_thread_num() % n], &cpu);
+        sched_setaffinity(0, sizeof(cpu), &cpu);
+    }
+    fprintf(stderr, "Affinity %s: %d threads over %d CPUs in %d NUMA node(s)\n", policy, omp_get_max_threads(), n, n_nodes);
+    return 1;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr, "Uso: %s [-e seq|push|gather|band|sparse|tile|steal|flow] [-t tile_size] [-k tile_gens]\n"
+                    "       [-o snapshot] [--checkpoint=file [--checkpoint-every=gens] [--checkpoint-seconds=secs]\n"
+                    "       [--resume]] [--series=file.csv | --series-binary=file] [--affinity=compact|spread]\n"
+                    "       [--trace=file | --trace-binary=file [--trace-every=gens] [--trace-region=r0,c0,rows,cols]]\n"
+                    "       [--early-exit]\n"
+                    "       [num_threads_positivo]   (without -e: the push engine on num_threads_positivo threads)\n"
+                    "       %s -e auto [options] [max_threads]   (engine and thread count chosen at startup;\n"
+                    "       also the default when neither -e nor a thread count is given)\n"
+                    "       %s --batch=manifest [--affinity=compact|spread] [num_threads_positivo]\n"
+                    "       %s --calibrate [max_threads]\n", prog, prog, prog, prog);
+    exit(EXIT_FAILURE);
+}
+
+// Pin the threads before the grids are first touched. The row loops of push and gather are
+// guided (schedule(runtime)) unless the threads are pinned: then they take the static row
+// blocks of first_touch, so each thread works on rows allocated on its own node
+void setup_threads(int n_threads, const char *affinity, const char *prog) {
+    omp_set_num_threads(n_threads);
+    if (affinity && !set_affinity(affinity)) usage(prog);
+    omp_set_schedule(affinity ? omp_sched_static : omp_sched_guided, 0);
+}
+
+int main(int argc, char *argv[]) {
+    omp_set_dynamic(0); // Disable dynamic teams
+
+    const Engine *engine = NULL; // NULL: chosen from the calibration table (-e auto)
+    int auto_engine = 0; // -e auto given
+    const char *snapshot = NULL; // Binary copy of the final world (-o)
+    int resume = 0; // Start from CKPT_PATH instead of stdin
+    const char *series = NULL; // Population time series (push engine)
+    int binary_series = 0;
+    const char *trace_path = NULL; // Generation trace (push engine)
+    int binary_trace = 0, trace_every = 1;
+    int region[4] = {0, 0, 0, 0}; // r0, c0, rows, cols of the trace (rows 0: the whole world)
+    const char *affinity = NULL; // compact or spread
+    const char *batch = NULL; // Manifest of independent scenarios (--batch)
+    int calibrate_only = 0; // --calibrate
+    static struct option long_options[] = {
+        {"checkpoint", required_argument, NULL, 'C'},
+        {"checkpoint-every", required_argument, NULL, 'K'},
+        {"checkpoint-seconds", required_argument, NULL, 'S'},
+        {"resume", no_argument, NULL, 'r'},
+        {"series", required_argument, NULL, 's'},
+        {"series-binary", required_argument, NULL, 'b'},
+        {"trace", required_argument, NULL, 'T'},
+        {"trace-binary", required_argument, NULL, 'Y'},
+        {"trace-every", required_argument, NULL, 'E'},
+        {"trace-region", required_argument, NULL, 'G'},
+        {"affinity", required_argument, NULL, 'a'},
+        {"batch", required_argument, NULL, 'B'},
+        {"calibrate", no_argument, NULL, 'L'},
+        {"early-exit", no_argument, NULL, 'X'},
+        {NULL, 0, NULL, 0}};
+    int opt;
+    while ((opt = getopt_long(argc, argv, "e:t:k:o:", long_options, NULL)) != -1) {
+        if (opt == 'C') { CKPT_PATH = optarg; continue; }
+        if (opt == 'K' && (CKPT_EVERY = atoi(optarg)) > 0) continue;
+        if (opt == 'S' && (CKPT_SECONDS = atof(optarg)) > 0) continue;
+        if (opt == 'r') { resume = 1; continue; }
+        if (opt == 'a') { affinity = optarg; continue; }
+        if (opt == 'B') { batch = optarg; continue; }
+        if (opt == 'L') { calibrate_only = 1; continue; }
+        if (opt == 'X') { early.enabled = 1; continue; }
+        if (opt == 's' || opt == 'b') { series = optarg; binary_series = opt == 'b'; continue; }
+        if (opt == 'T' || opt == 'Y') { trace_path = optarg; binary_trace = opt == 'Y'; continue; }
+        if (opt == 'E' && (trace_every = atoi(optarg)) > 0) continue;
+        if (opt == 'G' && sscanf(optarg, "%d,%d,%d,%d", &region[0], &region[1], &region[2], &region[3]) == 4 &&
+            region[0] >= 0 && region[1] >= 0 && region[2] > 0 && region[3] > 0) continue;
+        if (opt == 't' && (TILE_SIZE = STEAL_TILE = FLOW_ROWS = atoi(optarg)) > 0) continue;
+        if (opt == 'k' && (TILE_GENS = atoi(optarg)) > 0) continue;
+        if (opt == 'o') { snapshot = optarg; continue; }
+        if (opt == 'e' && strcmp(optarg, "auto") == 0) {
+            engine = NULL;
+            auto_engine = 1;
+        } else if (opt != 'e' || !(engine = find_engine(optarg))) usage(argv[0]);
+    }
+    if (resume && !CKPT_PATH) usage(argv[0]);
+    if (batch && (CKPT_PATH || series || snapshot || trace_path || early.enabled)) usage(argv[0]);
+    if (early.enabled && (series || trace_path)) {
+        fprintf(stderr, "--early-exit skips generations that --series and --trace record\n");
+        return 1;
+    }
+    if (early.enabled && engine && engine->run != run_push && engine->run != run_seq) {
+        fprintf(stderr, "--early-exit is only checked by the push and seq engines\n");
+        return 1;
+    }
+    if (series && engine && engine->run != run_push) {
+        fprintf(stderr, "--series is only gathered by the push engine\n");
+        return 1;
+    }
+    if (trace_path && engine && engine->run != run_push) {
+        fprintf(stderr, "--trace is only captured by the push engine\n");
+        return 1;
+    }
+
+    // Number of threads from the command line: the count to use with an explicit engine (default 1),
+    // the most threads -e auto may choose (default: the number of cores). Without -e a count runs
+    // the push engine on that many threads, as before -e auto existed; without either, -e auto
+    int n_threads = 0;
+    if (optind < argc && (n_threads = atoi(argv[optind])) <= 0) usage(argv[0]);
+    if (!engine && !auto_engine && n_threads > 0 && !batch && !calibrate_only) engine = find_engine("push");
+    int max_threads = n_threads > 0 ? n_threads : omp_get_num_procs();
+    const char *calibration = getenv("ECOSYSTEM_CALIBRATION");
+    if (!calibration) calibration = "ecosystem.calibration";
+    if (calibrate_only) return calibrate(calibration, max_threads);
+    if (batch) {
+        setup_threads(max_threads, affinity, argv[0]);
+        return run_batch(batch);
+    }
+
+    // Read input (text or binary world, see ecosystem_io.h), or the checkpoint to resume from
+    World world;
+    int fd = resume ? open(CKPT_PATH, O_RDONLY) : STDIN_FILENO;
+    if (fd < 0) {
+        fprintf(stderr, "Erro ao abrir %s\n", CKPT_PATH);
+        return 1;
+    }
+    if (!world_open(&world, fd)) return 1;
+    if (resume) close(fd);
+    if (resume && !world.checkpoint) {
+        fprintf(stderr, "%s is not a checkpoint\n", CKPT_PATH);
+        return 1;
+    }
+    if (!resume && !world_not_checkpoint(&world, "stdin")) return 1;
+    GEN_PROC_RABBITS = world.h.gen_proc_rabbits; GEN_PROC_FOXES = world.h.gen_proc_foxes;
+    GEN_FOOD_FOXES = world.h.gen_food_foxes; N_GEN = world.h.n_gen;
+    R = world.h.r; C = world.h.c; N = world.h.n;
+    if (!check_limits()) return 1;
+    if (region[2] == 0) {
+        region[2] = R;
+        region[3] = C;
+    }
+    if (trace_path && (region[0] + region[2] > R || region[1] + region[3] > C)) {
+        fprintf(stderr, "--trace-region outside the %dx%d grid\n", R, C);
+        return 1;
+    }
+
+    // Engine and thread count before anything runs in parallel, so a run that stays sequential
+    // never starts the thread team nor initialises the lock table
+    if (!engine) {
+        if (!load_costs(calibration)) default_costs(max_threads);
+        int push_only = series || trace_path;
+        const CostRow *row = select_engine(max_threads, push_only, N_GEN - world.h.gen);
+        if (!row) {
+            n_cost_rows = 0;
+            default_costs(max_threads);
+            row = select_engine(max_threads, push_only, N_GEN - world.h.gen);
+        }
+        engine = row->engine;
+        n_threads = row->threads;
+        fprintf(stderr, "Engine auto: %s, %d thread(s) (estimated %.3f milliseconds)\n", engine->name, n_threads,
+                estimate_ms(row, (double)R * C, N, N_GEN - world.h.gen));
+    }
+    setup_threads(n_threads > 0 ? n_threads : 1, affinity, argv[0]);
+
+    init_grids();
+    select_row_masks();
+#ifdef LOCK_FREE
+    fprintf(stderr, "Arena: %.1f MiB on %s pages\n", arena.size / (1024.0 * 1024.0), arena.pages);
+#else
+    fprintf(stderr, "Arena: %.1f MiB on %s pages, %d lock slots\n", arena.size / (1024.0 * 1024.0), arena.pages, n_locks);
+#endif
+
+    int loaded = world_load(&world, grid1.type) && world_load_ages(&world, grid1.proc_age, grid1.food_age, sizeof(Age));
+    int gen_from = world.h.gen;
+    world_close(&world);
+    if (!loaded) {
+        destroy_grids();
+        return 1;
+    }
+    if (resume) fprintf(stderr, "Resuming from generation %d of %d\n", gen_from, N_GEN);
+    // A resumed run appends to the series (rows from the checkpoint on are written again)
+    if (series && !series_open(series, binary_series, resume)) {
+        destroy_grids();
+        return 1;
+    }
+    if (trace_path && !trace_open(trace_path, binary_trace, resume, trace_every, region)) {
+        destroy_grids();
+        return 1;
     }
+
+    double start_time = omp_get_wtime(); // Start timing
+
+    run_checkpointed(engine->run, gen_from);
+
+    double end_time = omp_get_wtime(); // End timing
+    double elapsed_ms = ((double)(end_time - start_time)) * 1000.0;
+    // The series and trace writers drain their buffers outside the timed window
+    series_close();
+    trace_close();
+    double flush_ms = (omp_get_wtime() - end_time) * 1000.0;
+#ifdef PROFILE
+    profile_report(N_GEN);
+#endif
+    // Print Output (the object count is computed while formatting, see ecosystem_io.h)
+    WorldHeader out = {WORLD_MAGIC, GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES, 0, R, C, 0, 0, 0, {0}};
+    int written = world_write_text(STDOUT_FILENO, &out, grid1.type);
+    if (written && snapshot) written = world_write_binary(snapshot, &out, grid1.type);
+    if (early.skipped > 0 && early.period == 0)
+        fprintf(stderr, "No animals left from generation %d: %lld generations skipped\n", early.stop_gen, early.skipped);
+    else if (early.skipped > 0)
+        fprintf(stderr, "World repeats every %d generations from generation %d: %lld generations skipped\n",
+                early.period, early.stop_gen, early.skipped);
     fprintf(stderr, "Execution Time: %f milliseconds\n", elapsed_ms);
+    if (series || trace_path) fprintf(stderr, "Series and trace flush: %f milliseconds\n", flush_ms);
+    if (trace_path) trace_report(elapsed_ms, omp_get_max_threads());
+    if (early.saved.type) free_grid(&early.saved);
     destroy_grids();
-    return 0;
-}
\ No newline at end of file
+    return written && !ckpt.failed ? 0 : 1;
+}
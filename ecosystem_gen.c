@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "ecosystem_io.h"
+
+// Synthetic world generator: writes a world in the input format of ecosystem.c / ecosystem_seq.c.
+// Every cell is decided by a hash of (seed, cell index), so the world is reproducible and the
+// object count for the header is found by a first pass without keeping the world in memory;
+// the second pass streams the objects through a large output buffer. With -B the world is written
+// in the binary format of ecosystem_io.h, and -i converts an existing world instead of generating one.
+
+#define MAX_CLUSTERS 1024
+#define OUT_BUF_SIZE (1 << 22)
+
+int R = 1000, C = 1000, N_GEN = 100;
+int GEN_PROC_RABBITS = 3, GEN_PROC_FOXES = 20, GEN_FOOD_FOXES = 10;
+double P_ROCK = 0.05, P_RABBIT = 0.02, P_FOX = 0.005;
+uint64_t SEED = 1;
+int N_CLUSTERS = 0, RADIUS = 0;
+int BINARY = 0;
+const uint8_t *SOURCE = NULL; // Type plane of the world read with -i
+
+int cluster_r[MAX_CLUSTERS], cluster_c[MAX_CLUSTERS];
+double t_rock, t_rabbit, t_fox; // Cumulative thresholds inside the clusters (animals only)
+char *out_buf;
+size_t out_len;
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Uniform value in [0, 1) for cell idx
+double cell_random(uint64_t idx) {
+    return (splitmix64(SEED * 0x100000001B3ULL ^ idx) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Marks in `in` the columns of row i inside some cluster disc (everything without clusters)
+void cluster_row(int i, uint8_t *in) {
+    if (N_CLUSTERS == 0) {
+        memset(in, 1, C);
+        return;
+    }
+    memset(in, 0, C);
+    for (int k = 0; k < N_CLUSTERS; k++) {
+        int d = i - cluster_r[k];
+        if (d < -RADIUS || d > RADIUS) continue;
+        int half = (int)sqrt((double)RADIUS * RADIUS - (double)d * d);
+        int from = cluster_c[k] - half < 0 ? 0 : cluster_c[k] - half;
+        int to = cluster_c[k] + half >= C ? C - 1 : cluster_c[k] + half;
+        if (from <= to) memset(in + from, 1, to - from + 1);
+    }
+}
+
+int cell_type(uint64_t idx, int in_cluster) {
+    double u = cell_random(idx);
+    if (u < t_rock) return ROCK;
+    if (!in_cluster) return EMPTY;
+    if (u < t_rabbit) return RABBIT;
+    if (u < t_fox) return FOX;
+    return EMPTY;
+}
+
+void flush_out(void) {
+    if (out_len > 0 && fwrite(out_buf, 1, out_len, stdout) != out_len) {
+        fprintf(stderr, "Erro ao escrever o mundo\n");
+        exit(EXIT_FAILURE);
+    }
+    out_len = 0;
+}
+
+void put_bytes(const uint8_t *bytes, size_t n) {
+    while (n > 0) {
+        if (out_len == OUT_BUF_SIZE) flush_out();
+        size_t k = OUT_BUF_SIZE - out_len < n ? OUT_BUF_SIZE - out_len : n;
+        memcpy(out_buf + out_len, bytes, k);
+        out_len += k;
+        bytes += k;
+        n -= k;
+    }
+}
+
+void put_object(int type, int i, int j) {
+    static const char *names[] = {"", "ROCK ", "RABBIT ", "FOX "};
+    if (out_len > OUT_BUF_SIZE - 64) flush_out();
+    size_t n = strlen(names[type]);
+    memcpy(out_buf + out_len, names[type], n);
+    out_len += n;
+    char *p = format_int(out_buf + out_len, i);
+    *p++ = ' ';
+    p = format_int(p, j);
+    *p++ = '\n';
+    out_len = p - out_buf;
+}
+
+// Fills row i of the world
+void world_row(int i, uint8_t *in, uint8_t *row) {
+    if (SOURCE) {
+        memcpy(row, SOURCE + (size_t)i * C, C);
+        return;
+    }
+    cluster_row(i, in);
+    for (int j = 0; j < C; j++) row[j] = cell_type((uint64_t)i * C + j, in[j]);
+}
+
+// One pass over the world: counts the objects, and writes them when emit is set
+long long scan_world(int emit, uint8_t *in, uint8_t *row) {
+    long long count = 0;
+    for (int i = 0; i < R; i++) {
+        world_row(i, in, row);
+        for (int j = 0; j < C; j++) {
+            if (row[j] == EMPTY) continue;
+            count++;
+            if (emit && !BINARY) put_object(row[j], i, j);
+        }
+        if (emit && BINARY) put_bytes(row, C);
+    }
+    return count;
+}
+
+void usage(const char *prog) {
+    fprintf(stderr, "Uso: %s [-r rows] [-c cols] [-p rock_density] [-b rabbit_density] [-f fox_density]\n"
+                    "       [-k clusters] [-w cluster_radius] [-g gen_proc_rabbits,gen_proc_foxes,gen_food_foxes]\n"
+                    "       [-n n_gen] [-s seed] [-B] > world\n"
+                    "       %s -i world [-B] > world   (convert a text or binary world)\n", prog, prog);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    const char *input = NULL;
+    World world;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:c:p:b:f:k:w:g:n:s:Bi:")) != -1) {
+        switch (opt) {
+        case 'r': R = atoi(optarg); break;
+        case 'c': C = atoi(optarg); break;
+        case 'p': P_ROCK = atof(optarg); break;
+        case 'b': P_RABBIT = atof(optarg); break;
+        case 'f': P_FOX = atof(optarg); break;
+        case 'k': N_CLUSTERS = atoi(optarg); break;
+        case 'w': RADIUS = atoi(optarg); break;
+        case 'g':
+            if (sscanf(optarg, "%d,%d,%d", &GEN_PROC_RABBITS, &GEN_PROC_FOXES, &GEN_FOOD_FOXES) != 3) usage(argv[0]);
+            break;
+        case 'n': N_GEN = atoi(optarg); break;
+        case 's': SEED = strtoull(optarg, NULL, 10); break;
+        case 'B': BINARY = 1; break;
+        case 'i': input = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || R <= 0 || C <= 0 || (long long)R * C > 0x7FFFFFFF || N_GEN < 0 ||
+        P_ROCK < 0 || P_RABBIT < 0 || P_FOX < 0 || P_ROCK + P_RABBIT + P_FOX > 1 ||
+        N_CLUSTERS < 0 || N_CLUSTERS > MAX_CLUSTERS) usage(argv[0]);
+
+    if (input) {
+        int fd = open(input, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Erro ao abrir %s\n", input);
+            return EXIT_FAILURE;
+        }
+        int ok = world_open(&world, fd);
+        close(fd);
+        if (!ok || !world_not_checkpoint(&world, input)) return EXIT_FAILURE;
+        GEN_PROC_RABBITS = world.h.gen_proc_rabbits; GEN_PROC_FOXES = world.h.gen_proc_foxes;
+        GEN_FOOD_FOXES = world.h.gen_food_foxes; N_GEN = world.h.n_gen; R = world.h.r; C = world.h.c;
+        uint8_t *plane = (uint8_t *)calloc((size_t)R * C, sizeof(uint8_t));
+        if (!plane || !world_load(&world, plane)) return EXIT_FAILURE;
+        world_close(&world);
+        SOURCE = plane;
+        N_CLUSTERS = 0;
+    }
+
+    uint8_t *in = (uint8_t *)malloc(C);
+    uint8_t *row = (uint8_t *)malloc(C);
+    out_buf = (char *)malloc(OUT_BUF_SIZE);
+    if (!in || !row || !out_buf) {
+        fprintf(stderr, "Erro ao alocar memória\n");
+        return EXIT_FAILURE;
+    }
+
+    // Animals are only placed inside the cluster discs, with their density raised so the
+    // expected number of animals over the whole world stays the requested one
+    double scale = 1.0;
+    if (N_CLUSTERS > 0) {
+        if (RADIUS <= 0) RADIUS = (R < C ? R : C) / 20 + 1;
+        for (int k = 0; k < N_CLUSTERS; k++) {
+            cluster_r[k] = (int)(splitmix64(SEED + 2 * k + 1) % R);
+            cluster_c[k] = (int)(splitmix64(SEED + 2 * k + 2) % C);
+        }
+        long long covered = 0;
+        for (int i = 0; i < R; i++) {
+            cluster_row(i, in);
+            for (int j = 0; j < C; j++) covered += in[j];
+        }
+        scale = covered > 0 ? (double)R * C / covered : 0;
+    }
+    double animals = (P_RABBIT + P_FOX) * scale;
+    if (P_ROCK + animals > 1) scale *= (1 - P_ROCK) / animals;
+    t_rock = P_ROCK;
+    t_rabbit = t_rock + P_RABBIT * scale;
+    t_fox = t_rabbit + P_FOX * scale;
+
+    long long count = scan_world(0, in, row);
+    if (count > 0x7FFFFFFF) usage(argv[0]);
+    if (BINARY) {
+        WorldHeader h = {WORLD_MAGIC, GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES, N_GEN, R, C, (int32_t)count, 0, 0, {0}};
+        put_bytes((const uint8_t *)&h, sizeof(h));
+    } else {
+        printf("%d %d %d %d %d %d %lld\n", GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES, N_GEN, R, C, count);
+        fflush(stdout);
+    }
+    scan_world(1, in, row);
+    flush_out();
+
+    fprintf(stderr, "World %dx%d: %lld objects\n", R, C, count);
+    free(in);
+    free(row);
+    free(out_buf);
+    free((void *)SOURCE);
+    return 0;
+}
@@ -0,0 +1,396 @@
+// World input/output shared by ecosystem.c, ecosystem_seq.c, ecosystem_mpi.c and ecosystem_gen.c.
+// Everything is static inline so each program keeps building from its single .c file.
+#ifndef ECOSYSTEM_IO_H
+#define ECOSYSTEM_IO_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define EMPTY 0
+#define ROCK 1
+#define RABBIT 2
+#define FOX 3
+
+// Binary world: a WorldHeader followed by the R*C type plane, one byte per cell (EMPTY/ROCK/RABBIT/FOX).
+// The header is 64 bytes so the plane starts aligned; fields are stored in host byte order. The same
+// format is used for input worlds and for the final snapshot written with -o (n_gen 0, like the text output).
+// A checkpoint has its own magic and adds the proc_age and food_age planes (age_bytes per cell each);
+// gen is the next generation to run and n_gen the total of the run.
+#define WORLD_MAGIC "ECOWORLD"
+#define CHECKPOINT_MAGIC "ECOCHKPT"
+
+typedef struct {
+    char magic[8];
+    int32_t gen_proc_rabbits, gen_proc_foxes, gen_food_foxes, n_gen, r, c, n;
+    int32_t gen, age_bytes;
+    int32_t reserved[5];
+} WorldHeader;
+
+// An input world: the mapped file (or a copy of a pipe) and its parsed header
+typedef struct {
+    WorldHeader h;
+    const char *data;
+    size_t size;
+    size_t body;  // Offset of the first object (text) or of the type plane (binary)
+    int binary;
+    int checkpoint; // Binary with age planes
+    int mapped;
+} World;
+
+static inline int world_error(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    return 0;
+}
+
+static inline const char *skip_space(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r')) p++;
+    return p;
+}
+
+// Non-negative decimal integer; values that do not fit an int give -1 (out of bounds for the caller)
+static inline const char *parse_int(const char *p, const char *end, int *value) {
+    p = skip_space(p, end);
+    if (p == end || *p < '0' || *p > '9') return NULL;
+    long long v = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (v <= 0x7FFFFFFF) v = v * 10 + (*p - '0');
+        p++;
+    }
+    *value = v > 0x7FFFFFFF ? -1 : (int)v;
+    return p;
+}
+
+// Maps the world read from fd (a copy is read instead when fd is not a regular file) and parses its header
+static inline int world_open(World *w, int fd) {
+    memset(w, 0, sizeof(*w));
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            w->data = (const char *)data;
+            w->size = st.st_size;
+            w->mapped = 1;
+        }
+    }
+    if (!w->mapped) {
+        size_t cap = 1 << 20;
+        char *buf = (char *)malloc(cap);
+        ssize_t got;
+        while (buf && (got = read(fd, buf + w->size, cap - w->size)) > 0) {
+            w->size += got;
+            if (w->size < cap) continue;
+            char *grown = (char *)realloc(buf, cap *= 2);
+            if (!grown) free(buf);
+            buf = grown;
+        }
+        if (!buf) {
+            w->size = 0;
+            return world_error("Erro ao alocar memória");
+        }
+        w->data = buf;
+    }
+
+    if (w->size >= sizeof(WorldHeader) &&
+        (memcmp(w->data, WORLD_MAGIC, 8) == 0 || memcmp(w->data, CHECKPOINT_MAGIC, 8) == 0)) {
+        memcpy(&w->h, w->data, sizeof(WorldHeader));
+        w->binary = 1;
+        w->checkpoint = memcmp(w->data, CHECKPOINT_MAGIC, 8) == 0;
+        w->body = sizeof(WorldHeader);
+        size_t planes = w->checkpoint ? 1 + 2 * (size_t)w->h.age_bytes : 1;
+        if (w->h.r <= 0 || w->h.c <= 0 || w->size != w->body + (size_t)w->h.r * w->h.c * planes)
+            return world_error("Erro na leitura dos parâmetros iniciais (binary world truncated)");
+    } else {
+        int v[7];
+        const char *p = w->data, *end = w->data + w->size;
+        for (int k = 0; k < 7; k++)
+            if (!(p = parse_int(p, end, &v[k])) || v[k] < 0) return world_error("Erro na leitura dos parâmetros iniciais");
+        memcpy(w->h.magic, WORLD_MAGIC, 8);
+        w->h.gen = 0;
+        w->h.gen_proc_rabbits = v[0]; w->h.gen_proc_foxes = v[1]; w->h.gen_food_foxes = v[2];
+        w->h.n_gen = v[3]; w->h.r = v[4]; w->h.c = v[5]; w->h.n = v[6];
+        w->body = p - w->data;
+        if (w->h.r <= 0 || w->h.c <= 0) return world_error("Erro na leitura dos parâmetros iniciais");
+    }
+    return 1;
+}
+
+// Programs that run a world from generation 0 would drop a checkpoint's generation and ages
+static inline int world_not_checkpoint(const World *w, const char *name) {
+    if (!w->checkpoint) return 1;
+    fprintf(stderr, "%s is a checkpoint, not a world (resume it with ecosystem --resume)\n", name);
+    return 0;
+}
+
+// Parses the objects of [p, end) into the type plane; returns how many were read, -1 on error.
+// With shared set, other chunks are parsed concurrently: a cell is only claimed while it is still
+// empty, and *shared counts the objects whose cell was already taken
+static inline long long parse_objects(const char *p, const char *end, int R, int C, uint8_t *type, int *shared) {
+    long long count = 0;
+    while ((p = skip_space(p, end)) < end) {
+        const char *word = p;
+        while (p < end && *p >= 'A' && *p <= 'Z') p++;
+        size_t len = p - word;
+        int t = len == 4 && memcmp(word, "ROCK", 4) == 0     ? ROCK
+              : len == 6 && memcmp(word, "RABBIT", 6) == 0 ? RABBIT
+              : len == 3 && memcmp(word, "FOX", 3) == 0    ? FOX
+                                                           : EMPTY;
+        int r, c;
+        if (t == EMPTY || !(p = parse_int(p, end, &r)) || !(p = parse_int(p, end, &c))) {
+            fprintf(stderr, "Erro na leitura dos objetos iniciais (near \"%.*s\")\n", (int)(len < 16 ? len : 16), word);
+            return -1;
+        }
+        if (r < 0 || r >= R || c < 0 || c >= C) {
+            fprintf(stderr, "Erro na leitura dos objetos iniciais (%.*s %d %d is outside the %dx%d grid)\n",
+                    (int)len, word, r, c, R, C);
+            return -1;
+        }
+        uint8_t *cell = type + (size_t)r * C + c, empty = EMPTY;
+        if (!shared) *cell = (uint8_t)t;
+        else if (!__atomic_compare_exchange_n(cell, &empty, (uint8_t)t, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            (*shared)++;
+        count++;
+    }
+    return count;
+}
+
+// Fills the (zeroed) type plane with the world's objects. Text is split at line boundaries into one
+// chunk per OpenMP thread; objects are expected one per line. A cell listed twice holds the last
+// object, as in a sequential read: the chunks only claim empty cells, and when any cell is listed
+// again the objects are parsed once more in order.
+static inline int world_load(World *w, uint8_t *type) {
+    int R = w->h.r, C = w->h.c;
+    size_t cells = (size_t)R * C;
+    int n_chunks = 1;
+#ifdef _OPENMP
+    n_chunks = omp_get_max_threads();
+#endif
+    if (w->binary) {
+        const uint8_t *plane = (const uint8_t *)w->data + w->body;
+        long long count = 0;
+        int bad = 0;
+#ifdef _OPENMP
+        #pragma omp parallel for reduction(+:count) reduction(|:bad)
+#endif
+        for (int k = 0; k < n_chunks; k++) {
+            size_t from = cells * k / n_chunks, to = cells * (k + 1) / n_chunks;
+            memcpy(type + from, plane + from, to - from);
+            for (size_t i = from; i < to; i++) {
+                count += plane[i] != EMPTY;
+                bad |= plane[i] > FOX;
+            }
+        }
+        if (bad || count != w->h.n) return world_error("Erro na leitura dos objetos iniciais (binary world corrupted)");
+        return 1;
+    }
+
+    const char *end = w->data + w->size;
+    const char **start = (const char **)malloc((n_chunks + 1) * sizeof(const char *));
+    if (!start) return world_error("Erro ao alocar memória");
+    size_t len = w->size - w->body;
+    start[0] = w->data + w->body;
+    start[n_chunks] = end;
+    for (int k = 1; k < n_chunks; k++) {
+        const char *p = w->data + w->body + len * k / n_chunks;
+        if (p < start[k - 1]) p = start[k - 1];
+        while (p < end && p[-1] != '\n') p++;
+        start[k] = p;
+    }
+    long long count = 0;
+    int bad = 0, again = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(+:count, again) reduction(|:bad)
+#endif
+    for (int k = 0; k < n_chunks; k++) {
+        long long got = parse_objects(start[k], start[k + 1], R, C, type, &again);
+        if (got < 0) bad = 1;
+        else count += got;
+    }
+    if (!bad && again) {
+        memset(type, EMPTY, cells);
+        count = parse_objects(start[0], end, R, C, type, NULL);
+    }
+    free(start);
+    if (bad) return 0;
+    if (count != w->h.n) {
+        fprintf(stderr, "Erro na leitura dos objetos iniciais (%lld objects, header says %d)\n", count, w->h.n);
+        return 0;
+    }
+    return 1;
+}
+
+// Copies the age planes of a checkpoint; the ages must have the width of the program's Age type
+static inline int world_load_ages(World *w, void *proc_age, void *food_age, int age_bytes) {
+    if (!w->checkpoint) return 1;
+    if (w->h.age_bytes != age_bytes) {
+        fprintf(stderr, "Checkpoint has %d-bit ages, this build uses %d-bit ages\n", 8 * w->h.age_bytes, 8 * age_bytes);
+        return 0;
+    }
+    size_t bytes = (size_t)w->h.r * w->h.c * age_bytes;
+    const char *planes = w->data + w->body + (size_t)w->h.r * w->h.c;
+    memcpy(proc_age, planes, bytes);
+    memcpy(food_age, planes + bytes, bytes);
+    return 1;
+}
+
+static inline void world_close(World *w) {
+    if (w->mapped) munmap((void *)w->data, w->size);
+    else free((void *)w->data);
+    w->data = NULL;
+}
+
+static inline int write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t done = write(fd, data, size);
+        if (done < 0 && errno == EINTR) continue;
+        if (done <= 0) return world_error("Erro ao escrever o mundo");
+        data += done;
+        size -= done;
+    }
+    return 1;
+}
+
+// Decimal digits of v (v >= 0) at p; returns the end
+static inline char *format_int(char *p, int v) {
+    char tmp[12];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+    while (n > 0) *p++ = tmp[--n];
+    return p;
+}
+
+// Formats the objects of rows [from, to) into a growing buffer; returns how many there were
+static inline long long format_rows(const uint8_t *type, int C, int from, int to, char **buf, size_t *len) {
+    static const char *names[] = {"", "ROCK ", "RABBIT ", "FOX "};
+    static const size_t name_len[] = {0, 5, 7, 4};
+    size_t cap = 1 << 16, n = 0;
+    char *out = (char *)malloc(cap);
+    long long count = 0;
+    for (int i = from; i < to && out; i++) {
+        char row[12];
+        size_t row_len = format_int(row, i) - row;
+        const uint8_t *t = type + (size_t)i * C;
+        for (int j = 0; j < C; j++) {
+            if (t[j] == EMPTY) continue;
+            if (n + 32 > cap) {
+                char *grown = (char *)realloc(out, cap *= 2);
+                if (!grown) free(out);
+                if (!(out = grown)) break;
+            }
+            memcpy(out + n, names[t[j]], name_len[t[j]]);
+            n += name_len[t[j]];
+            memcpy(out + n, row, row_len);
+            n += row_len;
+            out[n++] = ' ';
+            n = format_int(out + n, j) - out;
+            out[n++] = '\n';
+            count++;
+        }
+    }
+    *buf = out;
+    *len = n;
+    return out ? count : -1;
+}
+
+// Writes the world in the text format to fd: each OpenMP thread formats a contiguous block of rows
+// into its own buffer, and the blocks are written in order with one write() each. The object count
+// for the header line is a by-product of the formatting and is stored in h->n. Returns 0 on error.
+static inline int world_write_text(int fd, WorldHeader *h, const uint8_t *type) {
+    int n_chunks = 1;
+#ifdef _OPENMP
+    n_chunks = omp_get_max_threads();
+#endif
+    if (n_chunks > h->r) n_chunks = h->r;
+    char **buf = (char **)calloc(n_chunks, sizeof(char *));
+    size_t *len = (size_t *)calloc(n_chunks, sizeof(size_t));
+    if (!buf || !len) return world_error("Erro ao alocar memória");
+    long long count = 0;
+    int bad = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(+:count) reduction(|:bad)
+#endif
+    for (int k = 0; k < n_chunks; k++) {
+        long long got = format_rows(type, h->c, (int)((long long)h->r * k / n_chunks),
+                                    (int)((long long)h->r * (k + 1) / n_chunks), &buf[k], &len[k]);
+        if (got < 0) bad = 1;
+        else count += got;
+    }
+    int ok = !bad || world_error("Erro ao alocar memória");
+    if (ok) {
+        char line[128];
+        h->n = (int32_t)count;
+        int n = snprintf(line, sizeof(line), "%d %d %d %d %d %d %d\n", h->gen_proc_rabbits, h->gen_proc_foxes,
+                         h->gen_food_foxes, h->n_gen, h->r, h->c, h->n);
+        ok = write_all(fd, line, n);
+        for (int k = 0; k < n_chunks && ok; k++) ok = write_all(fd, buf[k], len[k]);
+    }
+    for (int k = 0; k < n_chunks; k++) free(buf[k]);
+    free(buf);
+    free(len);
+    return ok;
+}
+
+// Writes the world as a binary snapshot (header and type plane) that can be mapped or read back as input
+static inline int world_write_binary(const char *path, const WorldHeader *h, const uint8_t *type) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Erro ao abrir %s\n", path);
+        return 0;
+    }
+    WorldHeader out = *h;
+    memcpy(out.magic, WORLD_MAGIC, 8);
+    int ok = write_all(fd, (const char *)&out, sizeof(out)) && write_all(fd, (const char *)type, (size_t)h->r * h->c);
+    return close(fd) == 0 && ok;
+}
+
+// Writes a checkpoint (header, type plane and both age planes) to path.tmp and renames it over path,
+// so an interrupted write leaves the previous checkpoint intact. The data reaches the disk before the
+// rename, and the rename before the next checkpoint, so a power loss cannot leave a truncated one.
+static inline int world_write_checkpoint(const char *path, const WorldHeader *h, const uint8_t *type,
+                                         const void *proc_age, const void *food_age) {
+    size_t cells = (size_t)h->r * h->c;
+    char *tmp = (char *)malloc(strlen(path) + 5);
+    if (!tmp) return world_error("Erro ao alocar memória");
+    sprintf(tmp, "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Erro ao abrir %s\n", tmp);
+        free(tmp);
+        return 0;
+    }
+    WorldHeader out = *h;
+    memcpy(out.magic, CHECKPOINT_MAGIC, 8);
+    int ok = write_all(fd, (const char *)&out, sizeof(out)) && write_all(fd, (const char *)type, cells) &&
+             write_all(fd, (const char *)proc_age, cells * h->age_bytes) &&
+             write_all(fd, (const char *)food_age, cells * h->age_bytes);
+    ok = ok && fsync(fd) == 0;
+    ok = close(fd) == 0 && ok && rename(tmp, path) == 0;
+    if (ok) {
+        // Directory of path, which holds the renamed entry
+        const char *slash = strrchr(path, '/');
+        size_t len = slash ? (size_t)(slash - path) + 1 : 0;
+        memcpy(tmp, path, len);
+        strcpy(tmp + len, ".");
+        int dir = open(tmp, O_RDONLY | O_DIRECTORY);
+        ok = dir >= 0 && fsync(dir) == 0;
+        if (dir >= 0) close(dir);
+    }
+    if (!ok) fprintf(stderr, "Erro ao escrever o checkpoint %s\n", path);
+    free(tmp);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <mpi.h>
+#include "ecosystem_io.h"
+
+// Results of rabbit_move / fox_move besides a direction
+#define STAY -1
+#define DIE -2
+
+// Ages are stored in narrow planes: 8 bits by default, 16 bits with -DWIDE_AGES.
+// Rabbit proc_age saturates at GEN_PROC_RABBITS + 1 (every age above GEN_PROC_RABBITS
+// behaves the same), fox ages are bounded by GEN_PROC_FOXES + GEN_FOOD_FOXES.
+#ifdef WIDE_AGES
+typedef uint16_t Age;
+#define AGE_MAX 0xFFFF
+#else
+typedef uint8_t Age;
+#define AGE_MAX 0xFF
+#endif
+
+// Value of a single cell, used to resolve conflicts
+typedef struct {
+    int type;
+    int proc_age;
+    int food_age;
+} Cell;
+
+// Structure-of-arrays grid: the neighbour scans only touch the type plane
+typedef struct {
+    uint8_t *type;
+    Age *proc_age;
+    Age *food_age;
+} Grid;
+
+// Every rank owns the rows [lo, hi) of the world. Its grids hold them as local rows
+// 1..n, plus a ghost row above (local row 0) and below (local row n + 1): during a phase
+// the ghost rows of the input grid hold the neighbouring ranks' boundary rows, and the
+// ghost rows of the output grid collect the moves that leave the block, which are sent
+// to the neighbouring rank and merged there with the conflict rules.
+int GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES, N_GEN, R, C, N_objects;
+int rank, n_ranks, lo, hi, n, up, down;
+MPI_Comm comm; // Ranks that own rows (at most R)
+Grid grid1;
+Grid grid2;
+uint8_t *halo_buf; // Packed ghost row (type plane followed by both age planes)
+
+const int dr[] = {-1, 0, 1, 0}; // N, E, S, W
+const int dc[] = {0, 1, 0, -1};
+
+void alloc_grid(Grid *g, size_t n_cells) {
+    g->type = (uint8_t *)calloc(n_cells, sizeof(uint8_t));
+    g->proc_age = (Age *)calloc(n_cells, sizeof(Age));
+    g->food_age = (Age *)calloc(n_cells, sizeof(Age));
+    if (!g->type || !g->proc_age || !g->food_age) {
+        fprintf(stderr, "Erro ao alocar memória\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+}
+
+void free_grid(Grid *g) {
+    free(g->type);
+    free(g->proc_age);
+    free(g->food_age);
+}
+
+Cell get_cell(Grid g, int idx) {
+    Cell cell = {g.type[idx], g.proc_age[idx], g.food_age[idx]};
+    return cell;
+}
+
+void set_cell(Grid g, int idx, Cell cell) {
+    g.type[idx] = (uint8_t)cell.type;
+    g.proc_age[idx] = (Age)cell.proc_age;
+    g.food_age[idx] = (Age)cell.food_age;
+}
+
+int get_adjacent_index(int gen, int r, int c, int p_count) {
+    // Calculate adjacent index with wrap-around
+    return (gen + r + c) % p_count;
+}
+
+void solve_rabbit_conflict(Cell *dest, int proc_age) {
+    if (dest->type == EMPTY) {
+        dest->type = RABBIT;
+        dest->proc_age = proc_age;
+    } else if (dest->type == RABBIT) {
+        if (proc_age > dest->proc_age) {
+            dest->proc_age = proc_age;
+        }
+    }
+}
+
+void solve_fox_conflict(Cell *dest, int proc_age, int food_age) {
+    if (dest->type == FOX) {
+        if (proc_age > dest->proc_age) {
+            dest->proc_age = proc_age;
+            dest->food_age = food_age;
+        } else if (proc_age == dest->proc_age) {
+            if (food_age < dest->food_age) {
+                dest->food_age = food_age;
+            }
+        }
+    } else { // Overwrite empty or rabbit
+        dest->type = FOX;
+        dest->proc_age = proc_age;
+        dest->food_age = food_age;
+    }
+}
+
+void merge_rabbit(Grid g, int idx, int proc_age) {
+    Cell cell = get_cell(g, idx);
+    solve_rabbit_conflict(&cell, proc_age);
+    set_cell(g, idx, cell);
+}
+
+void merge_fox(Grid g, int idx, int proc_age, int food_age) {
+    Cell cell = get_cell(g, idx);
+    solve_fox_conflict(&cell, proc_age, food_age);
+    set_cell(g, idx, cell);
+}
+
+// Directions k of local cell (li, j) whose neighbour in the type plane is of the given type.
+// Ghost rows stand for the rows above and below the block (ROCK outside the world).
+int neighbours_of_type(const uint8_t *type, int li, int j, int of_type, int *dirs) {
+    int count = 0;
+    for (int k = 0; k < 4; k++) {
+        int nj = j + dc[k];
+        if (nj >= 0 && nj < C && type[(li + dr[k]) * C + nj] == of_type) dirs[count++] = k;
+    }
+    return count;
+}
+
+// Exchange the boundary rows of the type plane with the neighbouring ranks
+void exchange_ghost_rows(Grid g) {
+    MPI_Sendrecv(g.type + C, C, MPI_UINT8_T, up, 0, g.type + (size_t)(n + 1) * C, C, MPI_UINT8_T, down, 0,
+                 comm, MPI_STATUS_IGNORE);
+    MPI_Sendrecv(g.type + (size_t)n * C, C, MPI_UINT8_T, down, 1, g.type, C, MPI_UINT8_T, up, 1,
+                 comm, MPI_STATUS_IGNORE);
+}
+
+void pack_row(Grid g, int li, uint8_t *buf) {
+    memcpy(buf, g.type + (size_t)li * C, C);
+    memcpy(buf + C, g.proc_age + (size_t)li * C, C * sizeof(Age));
+    memcpy(buf + C + C * sizeof(Age), g.food_age + (size_t)li * C, C * sizeof(Age));
+}
+
+// Send the moves collected in ghost row `from` to the neighbouring rank `to` and merge
+// the moves received from rank `from_rank` into local row `into`
+void exchange_halo(Grid g, int from, int to, int from_rank, int into, int species) {
+    int bytes = C * (1 + 2 * sizeof(Age));
+    uint8_t *send = halo_buf, *recv = halo_buf + bytes;
+    pack_row(g, from, send);
+    MPI_Sendrecv(send, bytes, MPI_UINT8_T, to, 2, recv, bytes, MPI_UINT8_T, from_rank, 2,
+                 comm, MPI_STATUS_IGNORE);
+    if (from_rank == MPI_PROC_NULL) return;
+    Age *proc_age = (Age *)(recv + C), *food_age = (Age *)(recv + C + C * sizeof(Age));
+    for (int j = 0; j < C; j++) {
+        if (recv[j] != species) continue;
+        if (species == RABBIT) merge_rabbit(g, into * C + j, proc_age[j]);
+        else merge_fox(g, into * C + j, proc_age[j], food_age[j]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &n_ranks);
+
+    const char *snapshot = NULL; // Binary copy of the final world (-o)
+    if (argc == 3 && strcmp(argv[1], "-o") == 0) snapshot = argv[2];
+    else if (argc != 1) {
+        if (rank == 0) fprintf(stderr, "Uso: %s [-o snapshot]\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    int params[7];
+    uint8_t *world = NULL; // Type plane of the whole world (rank 0)
+    if (rank == 0) {
+        // Read input (text or binary world, see ecosystem_io.h)
+        World input;
+        if (!world_open(&input, STDIN_FILENO) || !world_not_checkpoint(&input, "stdin")) MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        WorldHeader h = input.h;
+        params[0] = h.gen_proc_rabbits; params[1] = h.gen_proc_foxes; params[2] = h.gen_food_foxes;
+        params[3] = h.n_gen; params[4] = h.r; params[5] = h.c; params[6] = h.n;
+        if ((long long)h.r * h.c > 0x7FFFFFFF) {
+            fprintf(stderr, "Grid %dx%d exceeds the %d cells limit\n", h.r, h.c, 0x7FFFFFFF);
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+        world = (uint8_t *)calloc((size_t)h.r * h.c, sizeof(uint8_t));
+        if (!world || !world_load(&input, world)) MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        world_close(&input);
+    }
+    MPI_Bcast(params, 7, MPI_INT, 0, MPI_COMM_WORLD);
+    GEN_PROC_RABBITS = params[0]; GEN_PROC_FOXES = params[1]; GEN_FOOD_FOXES = params[2];
+    N_GEN = params[3]; R = params[4]; C = params[5]; N_objects = params[6];
+
+    // Ranks beyond the R-th would own no rows: leave them out of the simulation
+    MPI_Comm_split(MPI_COMM_WORLD, rank < R ? 0 : MPI_UNDEFINED, rank, &comm);
+    if (comm == MPI_COMM_NULL) {
+        MPI_Finalize();
+        return 0;
+    }
+    MPI_Comm_size(comm, &n_ranks);
+    if (GEN_PROC_RABBITS + 1 > AGE_MAX || GEN_PROC_FOXES + GEN_FOOD_FOXES > AGE_MAX) {
+        if (rank == 0) fprintf(stderr, "GEN_PROC_* / GEN_FOOD_FOXES exceed the %d-bit age planes (rebuild with -DWIDE_AGES)\n",
+                               (int)(8 * sizeof(Age)));
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Row blocks
+    lo = rank * R / n_ranks;
+    hi = (rank + 1) * R / n_ranks;
+    n = hi - lo;
+    up = rank > 0 ? rank - 1 : MPI_PROC_NULL;
+    down = rank < n_ranks - 1 ? rank + 1 : MPI_PROC_NULL;
+    alloc_grid(&grid1, (size_t)(n + 2) * C);
+    alloc_grid(&grid2, (size_t)(n + 2) * C);
+    halo_buf = (uint8_t *)malloc(2 * (size_t)C * (1 + 2 * sizeof(Age)));
+
+    int *counts = (int *)malloc(n_ranks * sizeof(int));
+    int *displs = (int *)malloc(n_ranks * sizeof(int));
+    for (int k = 0; k < n_ranks; k++) {
+        displs[k] = (k * R / n_ranks) * C;
+        counts[k] = ((k + 1) * R / n_ranks) * C - displs[k];
+    }
+    MPI_Scatterv(world, counts, displs, MPI_UINT8_T, grid1.type + C, n * C, MPI_UINT8_T, 0, comm);
+
+    // Outside the world the ghost rows stay ROCK, which blocks moves like the grid border
+    if (up == MPI_PROC_NULL) { memset(grid1.type, ROCK, C); memset(grid2.type, ROCK, C); }
+    if (down == MPI_PROC_NULL) { memset(grid1.type + (size_t)(n + 1) * C, ROCK, C); memset(grid2.type + (size_t)(n + 1) * C, ROCK, C); }
+
+    MPI_Barrier(comm);
+    double start_time = MPI_Wtime(); // Start timing
+
+    for (int gen = 0; gen < N_GEN; gen++) {
+        // =========== PHASE 1: RABBITS ===========
+        // Input: grid1, Output: grid2
+        exchange_ghost_rows(grid1);
+        for (int k = C; k < (n + 1) * C; k++) {
+            // Initialize grid2 with static elements from grid1
+            int keep = grid1.type[k] == ROCK || grid1.type[k] == FOX;
+            grid2.type[k] = keep ? grid1.type[k] : EMPTY;
+            grid2.proc_age[k] = keep ? grid1.proc_age[k] : 0;
+            grid2.food_age[k] = keep ? grid1.food_age[k] : 0;
+        }
+        // Ghost rows of the output collect the rabbits leaving the block
+        if (up != MPI_PROC_NULL) memset(grid2.type, EMPTY, C);
+        if (down != MPI_PROC_NULL) memset(grid2.type + (size_t)(n + 1) * C, EMPTY, C);
+
+        for (int li = 1; li <= n; li++) {
+            for (int j = 0; j < C; j++) {
+                int idx = li * C + j;
+                if (grid1.type[idx] != RABBIT) continue;
+                int possible[4];
+                int p_count = neighbours_of_type(grid1.type, li, j, EMPTY, possible);
+                int proc_age = grid1.proc_age[idx];
+                int new_proc_age = proc_age > GEN_PROC_RABBITS ? proc_age : proc_age + 1;
+                if (p_count == 0) {
+                    // Stay in place
+                    merge_rabbit(grid2, idx, new_proc_age);
+                    continue;
+                }
+                int dir = possible[get_adjacent_index(gen, lo + li - 1, j, p_count)];
+                if (new_proc_age > GEN_PROC_RABBITS) {
+                    // Leave baby at old position
+                    new_proc_age = 0;
+                    merge_rabbit(grid2, idx, 0);
+                }
+                merge_rabbit(grid2, (li + dr[dir]) * C + j + dc[dir], new_proc_age);
+            }
+        }
+        exchange_halo(grid2, 0, up, down, n, RABBIT);
+        exchange_halo(grid2, n + 1, down, up, 1, RABBIT);
+
+        // =========== PHASE 2: FOXES ===========
+        // Input: grid2, Output: grid1
+        exchange_ghost_rows(grid2);
+        for (int k = C; k < (n + 1) * C; k++) {
+            // Initialize grid1 with static elements from grid2
+            int keep = grid2.type[k] == ROCK || grid2.type[k] == RABBIT;
+            grid1.type[k] = keep ? grid2.type[k] : EMPTY;
+            grid1.proc_age[k] = keep ? grid2.proc_age[k] : 0;
+            grid1.food_age[k] = keep ? grid2.food_age[k] : 0;
+        }
+        if (up != MPI_PROC_NULL) memset(grid1.type, EMPTY, C);
+        if (down != MPI_PROC_NULL) memset(grid1.type + (size_t)(n + 1) * C, EMPTY, C);
+
+        for (int li = 1; li <= n; li++) {
+            for (int j = 0; j < C; j++) {
+                int idx = li * C + j;
+                if (grid2.type[idx] != FOX) continue;
+                int moves[4];
+                int count = neighbours_of_type(grid2.type, li, j, RABBIT, moves);
+                int ate = count > 0;
+                if (!ate) {
+                    // No prey found: starve, or try to move to an empty cell
+                    if (grid2.food_age[idx] + 1 >= GEN_FOOD_FOXES) continue;
+                    count = neighbours_of_type(grid2.type, li, j, EMPTY, moves);
+                }
+                int new_proc_age = grid2.proc_age[idx] + 1;
+                int new_food_age = ate ? 0 : grid2.food_age[idx] + 1;
+                if (count == 0) {
+                    // Stay in place
+                    merge_fox(grid1, idx, new_proc_age, new_food_age);
+                    continue;
+                }
+                int dir = moves[get_adjacent_index(gen, lo + li - 1, j, count)];
+                if (new_proc_age > GEN_PROC_FOXES) {
+                    // Leave baby at old position
+                    new_proc_age = 0;
+                    merge_fox(grid1, idx, 0, 0);
+                }
+                merge_fox(grid1, (li + dr[dir]) * C + j + dc[dir], new_proc_age, new_food_age);
+            }
+        }
+        exchange_halo(grid1, 0, up, down, n, FOX);
+        exchange_halo(grid1, n + 1, down, up, 1, FOX);
+    }
+
+    double elapsed_ms = (MPI_Wtime() - start_time) * 1000.0; // End timing
+
+    // =========== FINALIZATION ===========
+    MPI_Gatherv(grid1.type + C, n * C, MPI_UINT8_T, world, counts, displs, MPI_UINT8_T, 0, comm);
+    double max_ms;
+    MPI_Reduce(&elapsed_ms, &max_ms, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+    int written = 1;
+    if (rank == 0) {
+        // The object count is computed while formatting (see ecosystem_io.h)
+        WorldHeader out = {WORLD_MAGIC, GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES, 0, R, C, 0, 0, 0, {0}};
+        written = world_write_text(STDOUT_FILENO, &out, world);
+        if (written && snapshot) written = world_write_binary(snapshot, &out, world);
+        fprintf(stderr, "Execution Time (mpi, %d ranks): %.3f milliseconds\n", n_ranks, max_ms);
+        free(world);
+    }
+
+    free_grid(&grid1);
+    free_grid(&grid2);
+    free(halo_buf);
+    free(counts);
+    free(displs);
+    MPI_Finalize();
+    return written ? 0 : 1;
+}
@@ -2,12 +2,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdint.h>
+#include "ecosystem_io.h"
 
-#define EMPTY 0
-#define ROCK 1
-#define RABBIT 2
-#define FOX 3
-
+// The reference simulator keeps the original array of int cells, so it takes any GEN_PROC_* /
+// GEN_FOOD_FOXES (the narrow age planes are ecosystem.c's). ecosystem_io.h reads and writes the
+// world through a type plane.
 typedef struct {
     int type;
     int proc_age;
@@ -18,11 +18,13 @@ typedef struct {
 int GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES, N_GEN, R, C, N_objects;
 Cell *grid1;
 Cell *grid2;
+uint8_t *types; // Type plane of the world read and written
 
 void init_grids() {
-    grid1 = (Cell *)calloc(R * C, sizeof(Cell));
-    grid2 = (Cell *)calloc(R * C, sizeof(Cell));
-    if (!grid1 || !grid2) {
+    grid1 = (Cell *)calloc((size_t)R * C, sizeof(Cell));
+    grid2 = (Cell *)calloc((size_t)R * C, sizeof(Cell));
+    types = (uint8_t *)calloc((size_t)R * C, sizeof(uint8_t));
+    if (!grid1 || !grid2 || !types) {
         fprintf(stderr, "Erro ao alocar memória\n");
         exit(EXIT_FAILURE);
     }
@@ -31,6 +33,19 @@ void init_grids() {
 void destroy_grids() {
     free(grid1);
     free(grid2);
+    free(types);
+}
+
+// Check the world against the limits of the int indices and report its memory use
+int check_limits() {
+    if ((long long)R * C > 0x7FFFFFFF) {
+        fprintf(stderr, "Grid %dx%d exceeds the %d cells limit\n", R, C, 0x7FFFFFFF);
+        return 0;
+    }
+    size_t cell_bytes = 2 * sizeof(Cell) + sizeof(uint8_t);
+    fprintf(stderr, "Grid %dx%d: %zu bytes/cell, %.1f MiB\n", R, C, cell_bytes,
+            (double)R * C * cell_bytes / (1024.0 * 1024.0));
+    return 1;
 }
 
 int get_adjacent_index(int gen, int r, int c, int p_count) {
@@ -68,32 +83,31 @@ void solve_fox_conflict(Cell *dest, int proc_age, int food_age) {
     }
 }
 
-int main(void) {
-
-    if (scanf("%d %d %d %d %d %d %d", &GEN_PROC_RABBITS, &GEN_PROC_FOXES, &GEN_FOOD_FOXES, &N_GEN, &R, &C, &N_objects) != 7) {
-        fprintf(stderr, "Erro na leitura dos parâmetros iniciais\n");
+int main(int argc, char *argv[]) {
+    const char *snapshot = NULL; // Binary copy of the final world (-o)
+    if (argc == 3 && strcmp(argv[1], "-o") == 0) snapshot = argv[2];
+    else if (argc != 1) {
+        fprintf(stderr, "Uso: %s [-o snapshot]\n", argv[0]);
         return 1;
     }
 
+    // Read input (text or binary world, see ecosystem_io.h)
+    World world;
+    if (!world_open(&world, STDIN_FILENO) || !world_not_checkpoint(&world, "stdin")) return 1;
+    GEN_PROC_RABBITS = world.h.gen_proc_rabbits; GEN_PROC_FOXES = world.h.gen_proc_foxes;
+    GEN_FOOD_FOXES = world.h.gen_food_foxes; N_GEN = world.h.n_gen;
+    R = world.h.r; C = world.h.c; N_objects = world.h.n;
+    if (!check_limits()) return 1;
+
     init_grids();
 
-    for (int k = 0; k < N_objects; k++) {
-        char type[10];
-        int r, c;
-        if (scanf("%s %d %d", type, &r, &c) != 3) {
-            fprintf(stderr, "Erro na leitura dos objetos iniciais\n");
-            destroy_grids();
-            return 1;
-        }
-        int idx = r * C + c;
-        if (type[0] == 'R') {
-            if (type[1] == 'O')
-                grid1[idx].type = ROCK;
-            else
-                grid1[idx].type = RABBIT;
-        } else if (type[0] == 'F')
-            grid1[idx].type = FOX;
+    int loaded = world_load(&world, types);
+    world_close(&world);
+    if (!loaded) {
+        destroy_grids();
+        return 1;
     }
+    for (int k = 0; k < R * C; k++) grid1[k].type = types[k];
 
     clock_t start_time = clock(); // Start timing sequencial 
     // Directions: up, right, down, left
@@ -280,32 +294,15 @@ int main(void) {
     clock_t end_time = clock(); // End timing sequencial
     double elapsed_ms = ((double)(end_time - start_time)) / (double)CLOCKS_PER_SEC * 1000.0;
 
-    // Output final state of grid1 
-    int count = 0;
-    for (int i = 0; i < R * C; i++) {
-        if (grid1[i].type != EMPTY) {
-            count++;
-        }
-    }
-
-    printf("%d %d %d %d %d %d %d\n", GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES, 0, R, C, count);
-
-    // Print each object 
-    for (int i = 0; i < R; i++) {
-        for (int j = 0; j < C; j++) {
-            int idx = i * C + j;
-            if (grid1[idx].type == ROCK)
-                printf("ROCK %d %d\n", i, j);
-            else if (grid1[idx].type == RABBIT)
-                printf("RABBIT %d %d\n", i, j);
-            else if (grid1[idx].type == FOX)
-                printf("FOX %d %d\n", i, j);
-        }
-    }
+    // Output final state of grid1 (the object count is computed while formatting)
+    for (int k = 0; k < R * C; k++) types[k] = (uint8_t)grid1[k].type;
+    WorldHeader out = {WORLD_MAGIC, GEN_PROC_RABBITS, GEN_PROC_FOXES, GEN_FOOD_FOXES, 0, R, C, 0, 0, 0, {0}};
+    int written = world_write_text(STDOUT_FILENO, &out, types);
+    if (written && snapshot) written = world_write_binary(snapshot, &out, types);
 
     fprintf(stderr, "Execution Time (sequential): %.3f milliseconds\n", elapsed_ms);
 
     // Clean up
     destroy_grids();
-    return 0;
+    return written ? 0 : 1;
 }
\ No newline at end of file
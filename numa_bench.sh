@@ -0,0 +1,75 @@
+#!/bin/bash
+# NUMA scaling of ecosystem: thread placement (--affinity) and first-touch allocation.
+# Uso: ./numa_bench.sh [input]   (built and run by "make bench-numa")
+#
+# Environment:
+#   THREADS  thread counts                          (default: "1 2 4 8 16 32")
+#   REPS     repetitions of every run               (default: 3)
+#   ENGINES  engines to compare                     (default: "push band")
+#   OUT      result file                            (default: bench_numa.csv)
+#
+# Every engine runs with compact and spread placement, with the grids first touched by their
+# row owners (default) and by the master thread only (ECOSYSTEM_NO_FIRST_TOUCH=1, every page on
+# one node). Results go to $OUT as CSV (median and min of the times, speedup over 1 thread of the
+# same configuration); the outputs are checked against the first run.
+
+INPUT=${1:-ecosystem_examples/large/input5000x5000}
+THREADS=${THREADS:-"1 2 4 8 16 32"}
+REPS=${REPS:-3}
+ENGINES=${ENGINES:-"push band"}
+OUT=${OUT:-bench_numa.csv}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+nodes=$(ls -d /sys/devices/system/node/node[0-9]* 2>/dev/null | wc -l)
+echo "$(nproc) CPUs, ${nodes:-0} NUMA node(s)" >&2
+[ "${nodes:-0}" -gt 1 ] || echo "Aviso: single NUMA node, placement and first touch make little difference here" >&2
+
+failed=0
+: > "$TMP/times"
+for engine in $ENGINES; do
+    for affinity in compact spread; do
+        for touch in first master; do
+            off=0
+            [ "$touch" = master ] && off=1
+            for t in $THREADS; do
+                echo "$engine $affinity $touch $t" >&2
+                for ((rep = 0; rep < REPS; rep++)); do
+                    ECOSYSTEM_NO_FIRST_TOUCH=$off ./ecosystem -e "$engine" --affinity="$affinity" "$t" \
+                        < "$INPUT" > "$TMP/out" 2> "$TMP/err"
+                    [ -f "$TMP/expected" ] || cp "$TMP/out" "$TMP/expected"
+                    if ! cmp -s "$TMP/out" "$TMP/expected"; then
+                        echo "Erro: -e $engine --affinity=$affinity $t differs" >&2
+                        failed=1
+                    fi
+                    ms=$(grep -o 'Execution Time[^:]*: [0-9.]*' "$TMP/err" | awk '{print $NF}')
+                    echo "$engine $affinity $touch $t $ms" >> "$TMP/times"
+                done
+            done
+        done
+    done
+done
+
+awk '
+    {
+        key = $1 "," $2 "," $3 "," $4
+        if (!(key in n)) { order[++keys] = key; base[key] = $1 "," $2 "," $3 "," 1; thr[key] = $4 }
+        t[key, ++n[key]] = $5
+    }
+    END {
+        for (k = 1; k <= keys; k++) {
+            key = order[k]; m = n[key]
+            for (i = 1; i <= m; i++) v[i] = t[key, i]
+            for (i = 2; i <= m; i++) for (j = i; j > 1 && v[j - 1] > v[j]; j--) { x = v[j]; v[j] = v[j - 1]; v[j - 1] = x }
+            med[key] = m % 2 ? v[(m + 1) / 2] : (v[m / 2] + v[m / 2 + 1]) / 2
+            mn[key] = v[1]
+        }
+        print "engine,affinity,touch,threads,median_ms,min_ms,speedup"
+        for (k = 1; k <= keys; k++) {
+            key = order[k]; b = med[base[key]]
+            printf "%s,%.3f,%.3f,%.3f\n", key, med[key], mn[key], (b != "" && med[key] > 0) ? b / med[key] : 0
+        }
+    }' "$TMP/times" | tee "$OUT"
+
+echo "Results: $OUT" >&2
+exit $failed
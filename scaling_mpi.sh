@@ -0,0 +1,45 @@
+#!/bin/bash
+# Strong/weak scaling of the MPI program against the OpenMP program.
+# Uso: ./scaling_mpi.sh [input] [max_procs]   (default: ecosystem_examples/input200x200, nproc)
+#
+# Both programs are built by the makefile (make scaling, or CFLAGS=... ./scaling_mpi.sh), so they get the
+# same CFLAGS as any other run. Strong scaling runs the same input with p threads (./ecosystem p) and p ranks
+# (mpirun -np p ./ecosystem_mpi). Weak scaling stacks p copies of the input vertically,
+# so every thread/rank keeps the same number of rows. Both outputs are checked against
+# each other; the result is CSV on stdout: mode,procs,rows,omp_ms,mpi_ms
+
+INPUT=${1:-ecosystem_examples/input200x200}
+MAX_P=${2:-$(nproc)}
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+make -s --no-print-directory ecosystem ecosystem_mpi ${CFLAGS:+CFLAGS="$CFLAGS"} >&2 || exit 1
+
+# stack <input> <copies>: the same world repeated <copies> times along the rows
+stack() {
+    awk -v k="$2" 'NR == 1 { r = $5; n = $7; $5 = r * k; $7 = n * k; print; next }
+        { obj[NR] = $0 }
+        END { for (c = 0; c < k; c++) for (i = 2; i <= NR; i++) { split(obj[i], f, " "); print f[1], f[2] + c * r, f[3] } }' "$1"
+}
+
+run() { # run <mode> <p> <input>
+    ./ecosystem "$2" < "$3" > "$TMP/omp.out" 2> "$TMP/omp.err"
+    $MPIRUN -np "$2" ./ecosystem_mpi < "$3" > "$TMP/mpi.out" 2> "$TMP/mpi.err"
+    if ! cmp -s "$TMP/omp.out" "$TMP/mpi.out"; then
+        echo "Erro: outputs differ ($1, p=$2)" >&2
+        exit 1
+    fi
+    omp=$(grep -o 'Execution Time[^:]*: [0-9.]*' "$TMP/omp.err" | awk '{print $NF}')
+    mpi=$(grep -o 'Execution Time[^:]*: [0-9.]*' "$TMP/mpi.err" | awk '{print $NF}')
+    echo "$1,$2,$(head -1 "$3" | awk '{print $5}'),$omp,$mpi"
+}
+
+echo "mode,procs,rows,omp_ms,mpi_ms"
+for ((p = 1; p <= MAX_P; p *= 2)); do
+    run strong $p "$INPUT"
+done
+for ((p = 1; p <= MAX_P; p *= 2)); do
+    stack "$INPUT" $p > "$TMP/weak.in"
+    run weak $p "$TMP/weak.in"
+done